@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 #include "args.hpp"
 #include <kontsuba/converter.h>
@@ -11,6 +14,113 @@ int main(int argc, char const *argv[]) {
   args::HelpFlag help(parser, "help", "Display this help menu", {'h', "help"});
   args::Positional<std::string> input(required, "input", "Input file");
   args::Positional<std::string> output(required, "output", "Output directory");
+  std::unordered_map<std::string, Kontsuba::MeshFormat> meshFormats{
+      {"ply", Kontsuba::MeshFormat::Ply},
+      {"serialized", Kontsuba::MeshFormat::Serialized}};
+  args::MapFlag<std::string, Kontsuba::MeshFormat> meshFormat(
+      parser, "format", "Mesh output format (ply, serialized)",
+      {'f', "mesh-format"}, meshFormats, Kontsuba::MeshFormat::Ply);
+  std::unordered_map<std::string, Kontsuba::LinkMode> linkModes{
+      {"copy", Kontsuba::LinkMode::Copy},
+      {"hardlink", Kontsuba::LinkMode::Hardlink},
+      {"symlink", Kontsuba::LinkMode::Symlink},
+      {"reflink", Kontsuba::LinkMode::Reflink}};
+  args::MapFlag<std::string, Kontsuba::LinkMode> textureLinks(
+      parser, "mode",
+      "How textures are placed in the output (copy, hardlink, symlink, "
+      "reflink), links fall back to copies where unsupported",
+      {"texture-links"}, linkModes, Kontsuba::LinkMode::Copy);
+  std::unordered_map<std::string, Kontsuba::TextureFormat> textureFormats{
+      {"original", Kontsuba::TextureFormat::Original},
+      {"exr", Kontsuba::TextureFormat::Exr},
+      {"rgbe", Kontsuba::TextureFormat::Rgbe}};
+  args::MapFlag<std::string, Kontsuba::TextureFormat> textureFormat(
+      parser, "format",
+      "Transcode textures for faster loading (original, exr, rgbe)",
+      {"texture-format"}, textureFormats, Kontsuba::TextureFormat::Original);
+  args::ValueFlag<unsigned int> textureMaxResolution(
+      parser, "pixels",
+      "Halve transcoded textures until they fit this resolution",
+      {"texture-max-resolution"}, 0);
+  args::ValueFlag<unsigned int> jobs(
+      parser, "N", "Number of worker threads (default: all cores)",
+      {'j', "jobs"}, 0);
+  args::ValueFlag<unsigned int> textureJobs(
+      parser, "N",
+      "Number of textures copied concurrently with the mesh export "
+      "(default: 4, 0: all cores)",
+      {"texture-jobs"}, 4);
+  args::ValueFlag<uint64_t> memoryBudget(
+      parser, "MiB",
+      "Approximate memory the mesh export may use at once (default: 0, unlimited)",
+      {"memory-budget"}, 0);
+  args::Flag noMmap(parser, "no-mmap",
+                    "Read the input with buffered stdio instead of memory maps",
+                    {"no-mmap"});
+  args::Flag noFastObj(parser, "no-fast-obj",
+                       "Read .obj files with Assimp instead of the built-in loader",
+                       {"no-fast-obj"});
+  args::Flag instancing(parser, "instances",
+                        "Keep the scene hierarchy and write repeated meshes "
+                        "once as Mitsuba shapegroup instances",
+                        {'i', "instances"});
+  std::unordered_map<std::string, bool Kontsuba::PostProcessing::*> steps{
+      {"join-identical-vertices",
+       &Kontsuba::PostProcessing::joinIdenticalVertices},
+      {"find-degenerates", &Kontsuba::PostProcessing::findDegenerates},
+      {"fix-infacing-normals", &Kontsuba::PostProcessing::fixInfacingNormals},
+      {"flip-uvs", &Kontsuba::PostProcessing::flipUVs},
+      {"transform-uv-coords", &Kontsuba::PostProcessing::transformUVCoords}};
+  args::MapFlagList<std::string, bool Kontsuba::PostProcessing::*> skipSteps(
+      parser, "step", "Skip an Assimp post-processing step, may be repeated",
+      {"skip-step"}, steps);
+  args::Flag fast(parser, "fast",
+                  "Skip the expensive post-processing steps "
+                  "(join-identical-vertices, find-degenerates, "
+                  "fix-infacing-normals)",
+                  {"fast"});
+  args::Flag timePostProcessing(
+      parser, "time-post-processing",
+      "Print how long the import and each post-processing step took",
+      {"time-post-processing"});
+  args::Flag removeDuplicateFaces(
+      parser, "remove-duplicate-faces",
+      "Drop faces that duplicate another face of the same mesh",
+      {"remove-duplicate-faces"});
+  args::Flag mergeMeshes(
+      parser, "merge-meshes",
+      "Concatenate the meshes of each material into as few shapes as possible",
+      {"merge-meshes"});
+  args::ValueFlag<uint32_t> mergeMaxVertices(
+      parser, "vertices", "Maximum number of vertices of a merged shape",
+      {"merge-max-vertices"}, Kontsuba::Options().mergeMaxVertices);
+  args::ValueFlag<uint32_t> maxFacesPerShape(
+      parser, "faces",
+      "Split meshes with more faces into several shapes (default: 0, no splitting)",
+      {"max-faces-per-shape"}, 0);
+  args::Flag optimizeMeshOrder(
+      parser, "optimize-mesh-order",
+      "Reorder faces and vertices of each mesh for memory locality",
+      {"optimize-mesh-order"});
+  args::Flag stats(parser, "stats",
+                   "Print time, bytes written and resident memory per phase "
+                   "and the slowest meshes",
+                   {"stats"});
+  args::Flag statsJson(parser, "stats-json",
+                       "Write per phase and per mesh statistics to "
+                       "stats.json in the output directory",
+                       {"stats-json"});
+  args::ValueFlag<std::string> cache(
+      parser, "directory",
+      "Reuse previous conversions stored in this cache directory",
+      {"cache"});
+  args::Flag cacheHardlinks(parser, "cache-hardlinks",
+                            "Hardlink cached files instead of copying them",
+                            {"cache-hardlinks"});
+  args::Flag batch(parser, "batch",
+                   "Treat input as a directory or manifest of models and "
+                   "convert each into its own output subdirectory",
+                   {'b', "batch"});
   args::CompletionFlag completion(parser, {"complete"});
 
   try {
@@ -34,7 +144,61 @@ int main(int argc, char const *argv[]) {
   const std::string path = args::get(input);
   const std::string outputDir = args::get(output);
 
-  Kontsuba::convert(path, outputDir);
+  Kontsuba::Options options;
+  options.meshFormat = args::get(meshFormat);
+  options.textureLinks = args::get(textureLinks);
+  options.textureFormat = args::get(textureFormat);
+  options.textureMaxResolution = args::get(textureMaxResolution);
+  options.jobs = args::get(jobs);
+  options.textureJobs = args::get(textureJobs);
+  options.memoryBudget = args::get(memoryBudget) << 20;
+  options.memoryMapInput = !noMmap;
+  options.fastObj = !noFastObj;
+  options.instancing = instancing;
+  if (fast) {
+    options.postProcessing = Kontsuba::PostProcessing::fast();
+  }
+  for (auto step : args::get(skipSteps)) {
+    options.postProcessing.*step = false;
+  }
+  options.timePostProcessing = timePostProcessing;
+  options.removeDuplicateFaces = removeDuplicateFaces;
+  options.mergeMeshes = mergeMeshes;
+  options.mergeMaxVertices = args::get(mergeMaxVertices);
+  options.maxFacesPerShape = args::get(maxFacesPerShape);
+  options.optimizeMeshOrder = optimizeMeshOrder;
+  options.printStats = stats;
+  options.writeStatsJson = statsJson;
+  options.cacheDirectory = args::get(cache);
+  options.cacheHardlinks = cacheHardlinks;
+
+  if (batch) {
+    auto start = std::chrono::steady_clock::now();
+    auto results = Kontsuba::convertBatch(
+        path, outputDir, options, [](const Kontsuba::BatchResult &result) {
+          if (result.success) {
+            std::cout << "[ok] " << result.inputFile << " (" << result.seconds
+                      << "s)" << std::endl;
+          } else {
+            std::cout << "[failed] " << result.inputFile << ": "
+                      << result.error << std::endl;
+          }
+        });
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    size_t succeeded = std::count_if(
+        results.begin(), results.end(),
+        [](const Kontsuba::BatchResult &result) { return result.success; });
+    std::cout << "Converted " << succeeded << " of " << results.size()
+              << " models in " << seconds << "s ("
+              << (seconds > 0 ? results.size() / seconds : 0.0)
+              << " models/s)" << std::endl;
+    return succeeded == results.size() ? 0 : 1;
+  }
+
+  Kontsuba::convert(path, outputDir, options);
 
   return 0;
 }
@@ -0,0 +1,570 @@
+// Benchmarks of the conversion pipeline on procedurally generated scenes.
+//
+// Input scenes are generated once per size into kontsuba_bench in the
+// temporary directory and reused by later runs. The largest sizes take
+// minutes and several GB of disk and memory, select what to run with
+// --benchmark_filter, e.g. --benchmark_filter='Convert/ply/triangles:1000000/'.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+#include <tinyply.h>
+
+#include "converter.h"
+#include "import.h"
+#include "io_system.h"
+#include "mesh_processing.h"
+#include "ply.h"
+#include "principled_brdf.h"
+#include "stats.h"
+#include "tinyxml_writer.h"
+#include "xml_writer.h"
+
+namespace Kontsuba {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr int64_t kTriangleCounts[] = {1000, 10000, 100000, 1000000, 10000000, 50000000};
+constexpr int64_t kMeshCounts[] = {1, 10, 100, 1000, 10000, 100000};
+// triangles of the scenes that vary the number of meshes
+constexpr int64_t kTrianglesPerMeshSweep = 1000000;
+
+fs::path benchDirectory() {
+  fs::path directory = fs::temp_directory_path() / "kontsuba_bench";
+  fs::create_directories(directory);
+  return directory;
+}
+
+// (triangles, meshes): all triangle counts in one mesh, and all mesh counts
+// sharing kTrianglesPerMeshSweep triangles
+void sceneSizes(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgNames({"triangles", "meshes"});
+  for (int64_t triangles : kTriangleCounts) {
+    benchmark->Args({triangles, 1});
+  }
+  for (int64_t meshes : kMeshCounts) {
+    if (meshes > 1) {
+      benchmark->Args({kTrianglesPerMeshSweep, meshes});
+    }
+  }
+}
+
+void triangleCounts(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgName("triangles");
+  for (int64_t triangles : kTriangleCounts) {
+    benchmark->Arg(triangles);
+  }
+}
+
+void materialCounts(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgName("materials");
+  for (int64_t materials : kMeshCounts) {
+    benchmark->Arg(materials);
+  }
+}
+
+// Corners of triangle `t` of a grid `width` quads wide, as vertex indices
+// into a (width + 1) wide vertex grid
+std::array<uint64_t, 3> gridTriangle(uint64_t t, uint64_t width) {
+  uint64_t quad = t / 2;
+  uint64_t a = quad / width * (width + 1) + quad % width;
+  uint64_t b = a + 1, c = a + width + 2, d = a + width + 1;
+  return t % 2 == 0 ? std::array<uint64_t, 3>{a, b, c} : std::array<uint64_t, 3>{a, c, d};
+}
+
+uint64_t gridWidth(uint64_t triangles) {
+  return std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::sqrt(triangles / 2.0))));
+}
+
+uint64_t gridVertices(uint64_t triangles) {
+  uint64_t width = gridWidth(triangles);
+  uint64_t rows = ((triangles + 1) / 2 + width - 1) / width;
+  return (width + 1) * (rows + 1);
+}
+
+// A wavy grid of `triangles` triangles with normals and texture coordinates
+std::unique_ptr<aiMesh> gridMesh(uint64_t triangles) {
+  const uint64_t width = gridWidth(triangles);
+  auto mesh = std::make_unique<aiMesh>();
+  mesh->mName.Set("grid");
+  mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+  mesh->mNumVertices = static_cast<unsigned int>(gridVertices(triangles));
+  mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+  mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+  mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+  mesh->mNumUVComponents[0] = 2;
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    float x = static_cast<float>(i % (width + 1)), y = static_cast<float>(i / (width + 1));
+    mesh->mVertices[i] = aiVector3D(x, y, std::sin(x) * std::cos(y));
+    mesh->mNormals[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+    mesh->mTextureCoords[0][i] = aiVector3D(x / width, y / width, 0.0f);
+  }
+  mesh->mNumFaces = static_cast<unsigned int>(triangles);
+  mesh->mFaces = new aiFace[mesh->mNumFaces];
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    auto corners = gridTriangle(i, width);
+    aiFace &face = mesh->mFaces[i];
+    face.mNumIndices = 3;
+    face.mIndices = new unsigned int[3];
+    std::copy(corners.begin(), corners.end(), face.mIndices);
+  }
+  return mesh;
+}
+
+// A grid of `triangles` triangles whose second half repeats the first with
+// rotated or reversed corners. The repeats refer to a copy of the vertices,
+// so removeDuplicateFaces() has to match them by position.
+std::unique_ptr<aiMesh> gridMeshWithDuplicates(uint64_t triangles) {
+  auto grid = gridMesh(triangles / 2);
+  const unsigned int vertices = grid->mNumVertices, faces = grid->mNumFaces;
+  auto mesh = std::make_unique<aiMesh>();
+  mesh->mName.Set("duplicates");
+  mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+  mesh->mNumVertices = 2 * vertices;
+  mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+  mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+  mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+  mesh->mNumUVComponents[0] = 2;
+  for (unsigned int copy = 0; copy < 2; copy++) {
+    std::copy(grid->mVertices, grid->mVertices + vertices, mesh->mVertices + copy * vertices);
+    std::copy(grid->mNormals, grid->mNormals + vertices, mesh->mNormals + copy * vertices);
+    std::copy(grid->mTextureCoords[0], grid->mTextureCoords[0] + vertices,
+              mesh->mTextureCoords[0] + copy * vertices);
+  }
+  mesh->mNumFaces = 2 * faces;
+  mesh->mFaces = new aiFace[mesh->mNumFaces];
+  for (unsigned int i = 0; i < faces; i++) {
+    const unsigned int *corners = grid->mFaces[i].mIndices;
+    for (unsigned int copy = 0; copy < 2; copy++) {
+      aiFace &face = mesh->mFaces[copy * faces + i];
+      face.mNumIndices = 3;
+      face.mIndices = new unsigned int[3];
+      for (unsigned int c = 0; c < 3; c++) {
+        // the repeat starts at another corner and every other one is flipped
+        unsigned int source = copy == 0 ? c : (i % 2 == 0 ? c + i : i + 3 - c) % 3;
+        face.mIndices[c] = corners[source] + copy * vertices;
+      }
+    }
+  }
+  return mesh;
+}
+
+// An OBJ scene of `meshes` grids with one material each that share
+// `triangles` triangles, generated on first use
+const fs::path &objScene(int64_t triangles, int64_t meshes) {
+  static std::map<std::pair<int64_t, int64_t>, fs::path> scenes;
+  auto [known, added] = scenes.emplace(std::make_pair(triangles, meshes), fs::path());
+  if (!added) {
+    return known->second;
+  }
+  std::string name = fmt::format("scene-{}-{}", triangles, meshes);
+  const fs::path &file = known->second = benchDirectory() / (name + ".obj");
+  if (fs::exists(file)) {
+    return file;
+  }
+
+  std::ofstream mtl(benchDirectory() / (name + ".mtl"));
+  for (int64_t m = 0; m < meshes; m++) {
+    mtl << fmt::format("newmtl m{}\nKd {} 0.5 0.5\nNs {}\n", m,
+                       static_cast<float>(m) / meshes, 10 + m % 100);
+  }
+
+  // written to a temporary name so interrupted runs do not leave a
+  // truncated scene behind
+  fs::path partial = file;
+  partial += ".partial";
+  std::ofstream obj(partial, std::ios::binary);
+  obj << fmt::format("mtllib {}.mtl\n", name);
+  std::string buffer;
+  auto flush = [&](bool force) {
+    if (force || buffer.size() > (1 << 20)) {
+      obj.write(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  };
+  uint64_t firstVertex = 1;
+  for (int64_t m = 0; m < meshes; m++) {
+    uint64_t count = triangles / meshes + (m < triangles % meshes ? 1 : 0);
+    uint64_t width = gridWidth(count);
+    uint64_t vertices = gridVertices(count);
+    buffer += fmt::format("o grid{}\nusemtl m{}\n", m, m);
+    for (uint64_t i = 0; i < vertices; i++) {
+      float x = static_cast<float>(i % (width + 1)), y = static_cast<float>(i / (width + 1));
+      fmt::format_to(std::back_inserter(buffer), "v {} {} {}\nvt {} {}\nvn 0 0 1\n", x, y,
+                     std::sin(x) * std::cos(y) + m, x / width, y / width);
+      flush(false);
+    }
+    for (uint64_t t = 0; t < count; t++) {
+      auto c = gridTriangle(t, width);
+      for (auto &index : c) {
+        index += firstVertex;
+      }
+      fmt::format_to(std::back_inserter(buffer), "f {0}/{0}/{0} {1}/{1}/{1} {2}/{2}/{2}\n",
+                     c[0], c[1], c[2]);
+      flush(false);
+    }
+    firstVertex += vertices;
+  }
+  flush(true);
+  obj.close();
+  fs::rename(partial, file);
+  return file;
+}
+
+// `count` materials with a few colors and factors; every other one has a
+// diffuse texture and every fourth a normal map
+std::vector<std::unique_ptr<aiMaterial>> makeMaterials(int64_t count) {
+  std::vector<std::unique_ptr<aiMaterial>> materials;
+  for (int64_t i = 0; i < count; i++) {
+    auto material = std::make_unique<aiMaterial>();
+    aiString name(fmt::format("material{}", i));
+    material->AddProperty(&name, AI_MATKEY_NAME);
+    aiColor3D diffuse(static_cast<float>(i % 256) / 255.0f, 0.5f, 0.25f);
+    material->AddProperty(&diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+    aiColor3D specular(0.04f, 0.04f, 0.04f);
+    material->AddProperty(&specular, 1, AI_MATKEY_COLOR_SPECULAR);
+    float shininess = static_cast<float>(i % 100);
+    material->AddProperty(&shininess, 1, AI_MATKEY_SHININESS);
+    float roughness = 0.5f;
+    material->AddProperty(&roughness, 1, AI_MATKEY_ROUGHNESS_FACTOR);
+    if (i % 2 == 0) {
+      aiString texture(fmt::format("textures/diffuse{}.png", i));
+      material->AddProperty(&texture, AI_MATKEY_TEXTURE(aiTextureType_DIFFUSE, 0));
+    }
+    if (i % 4 == 0) {
+      aiString texture(fmt::format("textures/normal{}.png", i));
+      material->AddProperty(&texture, AI_MATKEY_TEXTURE(aiTextureType_NORMALS, 0));
+    }
+    materials.push_back(std::move(material));
+  }
+  return materials;
+}
+
+std::string placedTexture(const Texture &texture, bool) { return texture; }
+
+// writes the mesh with tinyply from copies of its arrays like the converter
+// did before writePly, as a baseline
+void writePlyTinyply(const std::string &filename, const aiMesh *mesh,
+                     std::vector<uint32_t> &indices) {
+  std::vector<aiVector3D> positions(mesh->mVertices, mesh->mVertices + mesh->mNumVertices);
+  std::vector<aiVector3D> normals(mesh->mNormals, mesh->mNormals + mesh->mNumVertices);
+  std::vector<aiVector2D> texcoords;
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    texcoords.emplace_back(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+  }
+  tinyply::PlyFile file;
+  file.add_properties_to_element("vertex", {"x", "y", "z"}, tinyply::Type::FLOAT32,
+                                 positions.size(),
+                                 reinterpret_cast<uint8_t *>(positions.data()),
+                                 tinyply::Type::INVALID, 0);
+  file.add_properties_to_element("vertex", {"nx", "ny", "nz"}, tinyply::Type::FLOAT32,
+                                 normals.size(), reinterpret_cast<uint8_t *>(normals.data()),
+                                 tinyply::Type::INVALID, 0);
+  file.add_properties_to_element("vertex", {"u", "v"}, tinyply::Type::FLOAT32,
+                                 texcoords.size(),
+                                 reinterpret_cast<uint8_t *>(texcoords.data()),
+                                 tinyply::Type::INVALID, 0);
+  file.add_properties_to_element("face", {"vertex_indices"}, tinyply::Type::UINT32,
+                                 indices.size() / 3,
+                                 reinterpret_cast<uint8_t *>(indices.data()),
+                                 tinyply::Type::UINT8, 3);
+  std::ofstream stream(filename, std::ios::binary);
+  file.write(stream, true);
+}
+
+// Resets the peak resident set size the kernel tracks for the process, so
+// that peakResidentBytes() covers only what runs afterwards. Linux only.
+bool resetPeakResident() {
+#ifdef __GLIBC__
+  // return memory freed by earlier iterations, which would otherwise be
+  // reused without raising the resident set size
+  malloc_trim(0);
+#endif
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5" << std::flush;
+  return clearRefs.good();
+}
+
+uint64_t peakResidentBytes() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::stoull(line.substr(6)) * 1024;
+    }
+  }
+  return 0;
+}
+
+// Imports a scene like convert() does. Besides the time, reports by how much
+// the import raised the resident set size at its peak where the platform
+// allows measuring it, e.g. to compare memory mapped and stdio input.
+void BM_Import(benchmark::State &state, bool fastObj, bool memoryMapInput) {
+  const fs::path &file = objScene(state.range(0), state.range(1));
+  Options options;
+  options.fastObj = fastObj;
+  options.memoryMapInput = memoryMapInput;
+  uint64_t importPeak = 0;
+  bool measurePeak = true;
+  for (auto _ : state) {
+    state.PauseTiming();
+    measurePeak = measurePeak && resetPeakResident();
+    uint64_t before = currentResidentBytes();
+    state.ResumeTiming();
+    {
+      Assimp::Importer importer;
+      importer.SetIOHandler(inputIOSystem(options).release());
+      std::unique_ptr<aiScene> ownedScene;
+      benchmark::DoNotOptimize(importScene(importer, file, options, ownedScene));
+      state.PauseTiming();
+      uint64_t peak = peakResidentBytes();
+      importPeak = std::max(importPeak, peak > before ? peak - before : 0);
+      state.ResumeTiming();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  if (measurePeak) {
+    state.counters["import_peak_mib"] = importPeak / (1024.0 * 1024.0);
+  }
+}
+BENCHMARK_CAPTURE(BM_Import, fast_obj, true, true)
+    ->Apply(sceneSizes)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Import, fast_obj_stdio, true, false)
+    ->Apply(sceneSizes)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Import, assimp, false, true)
+    ->Apply(sceneSizes)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Import, assimp_stdio, false, false)
+    ->Apply(sceneSizes)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+void BM_FromMaterial(benchmark::State &state) {
+  auto materials = makeMaterials(state.range(0));
+  for (auto _ : state) {
+    for (auto &material : materials) {
+      benchmark::DoNotOptimize(PrincipledBRDF::fromMaterial(material.get(), true));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FromMaterial)->Apply(materialCounts);
+
+std::vector<PrincipledBRDF> makeBRDFs(int64_t count) {
+  std::vector<PrincipledBRDF> brdfs;
+  for (auto &material : makeMaterials(count)) {
+    brdfs.push_back(PrincipledBRDF::fromMaterial(material.get(), true));
+  }
+  return brdfs;
+}
+
+void BM_ToXML(benchmark::State &state) {
+  auto brdfs = makeBRDFs(state.range(0));
+  std::string filename = (benchDirectory() / "materials.xml").string();
+  for (auto _ : state) {
+    XMLWriter xml(filename);
+    xml.open("scene").attribute("version", "3.0.0");
+    for (const auto &brdf : brdfs) {
+      toXML(xml, brdf, placedTexture);
+    }
+    xml.finish();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ToXML)->Apply(materialCounts);
+
+void BM_ToXMLTinyxml2(benchmark::State &state) {
+  auto brdfs = makeBRDFs(state.range(0));
+  std::string filename = (benchDirectory() / "materials-tinyxml2.xml").string();
+  for (auto _ : state) {
+    TinyXMLWriter xml;
+    xml.open("scene").attribute("version", "3.0.0");
+    for (const auto &brdf : brdfs) {
+      toXML(xml, brdf, placedTexture);
+    }
+    xml.close();
+    xml.save(filename);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ToXMLTinyxml2)->Apply(materialCounts);
+
+void BM_WritePly(benchmark::State &state, bool removeDuplicates) {
+  // removing duplicates writes half of the faces
+  auto mesh = removeDuplicates ? gridMeshWithDuplicates(state.range(0))
+                               : gridMesh(state.range(0));
+  std::string filename = (benchDirectory() / "mesh.ply").string();
+  for (auto _ : state) {
+    auto indices = triangleIndices(mesh.get());
+    if (removeDuplicates) {
+      removeDuplicateFaces(mesh.get(), indices);
+    }
+    writePly(filename, mesh.get(), indices);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fs::file_size(filename)));
+}
+BENCHMARK_CAPTURE(BM_WritePly, plain, false)
+    ->Apply(triangleCounts)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_WritePly, remove_duplicate_faces, true)
+    ->Apply(triangleCounts)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_RemoveDuplicateFaces(benchmark::State &state) {
+  auto mesh = gridMeshWithDuplicates(state.range(0));
+  const auto indices = triangleIndices(mesh.get());
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto remaining = indices;
+    state.ResumeTiming();
+    removeDuplicateFaces(mesh.get(), remaining);
+    if (remaining.size() != indices.size() / 2) {
+      state.SkipWithError(
+          fmt::format("{} of {} faces left", remaining.size() / 3, mesh->mNumFaces).c_str());
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * mesh->mNumFaces);
+  state.SetComplexityN(mesh->mNumFaces);
+}
+BENCHMARK(BM_RemoveDuplicateFaces)
+    ->ArgName("triangles")
+    ->RangeMultiplier(4)
+    ->Range(1 << 12, 1 << 24)
+    ->Unit(benchmark::kMillisecond)
+    ->Complexity(benchmark::oN);
+
+// Times the face and vertex reordering of --optimize-mesh-order on `meshes`
+// and reports the average vertex cache miss ratio before and after it
+void measureMeshOrder(benchmark::State &state,
+                      const std::vector<std::pair<const aiMesh *, std::vector<uint32_t>>> &meshes) {
+  uint64_t faces = 0, missesBefore = 0, missesAfter = 0;
+  for (const auto &[mesh, indices] : meshes) {
+    faces += indices.size() / 3;
+    missesBefore += cacheMisses(indices, mesh->mNumVertices);
+    auto optimized = indices;
+    optimizeFaceOrder(optimized, mesh->mNumVertices);
+    missesAfter += cacheMisses(optimized, mesh->mNumVertices);
+  }
+  for (auto _ : state) {
+    for (const auto &[mesh, original] : meshes) {
+      state.PauseTiming();
+      auto indices = original;
+      state.ResumeTiming();
+      optimizeFaceOrder(indices, mesh->mNumVertices);
+      benchmark::DoNotOptimize(optimizeVertexOrder(mesh, indices));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * faces);
+  state.counters["acmr_before"] = static_cast<double>(missesBefore) / faces;
+  state.counters["acmr_after"] = static_cast<double>(missesAfter) / faces;
+}
+
+// a grid whose faces are drawn in random order, as in meshes that were
+// assembled without regard for locality
+void BM_OptimizeMeshOrderShuffledGrid(benchmark::State &state) {
+  auto mesh = gridMesh(state.range(0));
+  auto indices = triangleIndices(mesh.get());
+  std::vector<uint32_t> order(indices.size() / 3);
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937(1));
+  std::vector<uint32_t> shuffled;
+  shuffled.reserve(indices.size());
+  for (uint32_t face : order) {
+    shuffled.insert(shuffled.end(), &indices[3 * face], &indices[3 * face] + 3);
+  }
+  measureMeshOrder(state, {{mesh.get(), std::move(shuffled)}});
+}
+BENCHMARK(BM_OptimizeMeshOrderShuffledGrid)
+    ->Apply(triangleCounts)
+    ->Unit(benchmark::kMillisecond);
+
+// the meshes of the test model as convert() imports them
+void BM_OptimizeMeshOrderTestModel(benchmark::State &state) {
+  fs::path file = fs::path(KONTSUBA_TEST_MODELS) / "shapenet/models/model_normalized.obj";
+  if (!fs::exists(file)) {
+    state.SkipWithError(("missing " + file.string()).c_str());
+    return;
+  }
+  Options options;
+  Assimp::Importer importer;
+  importer.SetIOHandler(inputIOSystem(options).release());
+  std::unique_ptr<aiScene> ownedScene;
+  const aiScene *scene = importScene(importer, file, options, ownedScene);
+  std::vector<std::pair<const aiMesh *, std::vector<uint32_t>>> meshes;
+  for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
+    meshes.emplace_back(scene->mMeshes[i], triangleIndices(scene->mMeshes[i]));
+  }
+  measureMeshOrder(state, meshes);
+}
+BENCHMARK(BM_OptimizeMeshOrderTestModel)->Unit(benchmark::kMillisecond);
+
+void BM_WritePlyTinyply(benchmark::State &state) {
+  auto mesh = gridMesh(state.range(0));
+  std::string filename = (benchDirectory() / "mesh-tinyply.ply").string();
+  for (auto _ : state) {
+    auto indices = triangleIndices(mesh.get());
+    writePlyTinyply(filename, mesh.get(), indices);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fs::file_size(filename)));
+}
+BENCHMARK(BM_WritePlyTinyply)->Apply(triangleCounts)->Unit(benchmark::kMillisecond);
+
+void BM_Convert(benchmark::State &state, MeshFormat format) {
+  const fs::path &file = objScene(state.range(0), state.range(1));
+  fs::path output = benchDirectory() / "output";
+  Options options;
+  options.meshFormat = format;
+  for (auto _ : state) {
+    // start from an empty directory like a first conversion
+    state.PauseTiming();
+    fs::remove_all(output);
+    fs::create_directories(output);
+    state.ResumeTiming();
+    convert(file.string(), output.string(), options);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_Convert, ply, MeshFormat::Ply)
+    ->Apply(sceneSizes)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Convert, serialized, MeshFormat::Serialized)
+    ->Apply(sceneSizes)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+} // namespace
+
+} // namespace Kontsuba
+
+BENCHMARK_MAIN();
@@ -1,16 +1,268 @@
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <nanobind/nanobind.h>
+#include <nanobind/ndarray.h>
+#include <nanobind/stl/pair.h>
 #include <nanobind/stl/string.h>
+#include <nanobind/stl/vector.h>
 
 #include <kontsuba/converter.h>
+#include <kontsuba/scene.h>
 
 namespace nb = nanobind;
 using namespace nb::literals;
 
+namespace {
+
+// numbers of a property value such as "1, 1, 0" or "0.5,0.5,0.5"
+nb::list parseNumbers(const std::string &text) {
+  nb::list numbers;
+  const char *cursor = text.c_str();
+  while (*cursor) {
+    char *end;
+    double value = std::strtod(cursor, &end);
+    if (end == cursor) {
+      cursor++;
+      continue;
+    }
+    numbers.append(value);
+    cursor = end;
+  }
+  return numbers;
+}
+
+std::string attributeOr(const Kontsuba::Element &element, const std::string &key,
+                        const std::string &fallback) {
+  const std::string *value = element.attribute(key);
+  return value ? *value : fallback;
+}
+
+nb::object toPython(const Kontsuba::Element &element);
+
+// Adds the children of an element to `dict` following Mitsuba's dictionary
+// format: properties are keyed by their name, nested objects by name or id
+void addChildren(nb::dict &dict, const std::vector<Kontsuba::Element> &children) {
+  std::map<std::string, int> counts;
+  for (const auto &child : children) {
+    std::string key = attributeOr(child, "name", attributeOr(child, "id", child.name));
+    if (counts[key]++ > 0) {
+      key += "_" + std::to_string(counts[key] - 1);
+    }
+    dict[key.c_str()] = toPython(child);
+  }
+}
+
+nb::object toPython(const Kontsuba::Element &element) {
+  const std::string &tag = element.name;
+  std::string value = attributeOr(element, "value", "");
+  if (tag == "float") {
+    return nb::float_(std::strtod(value.c_str(), nullptr));
+  }
+  if (tag == "integer") {
+    return nb::int_(std::strtol(value.c_str(), nullptr, 10));
+  }
+  if (tag == "boolean") {
+    return nb::bool_(value == "true");
+  }
+  if (tag == "string") {
+    return nb::str(value.c_str());
+  }
+  if (tag == "point" || tag == "vector") {
+    return parseNumbers(value);
+  }
+  if (tag == "rgb") {
+    nb::dict rgb;
+    rgb["type"] = "rgb";
+    rgb["value"] = parseNumbers(value);
+    return rgb;
+  }
+  if (tag == "ref") {
+    nb::dict ref;
+    ref["type"] = "ref";
+    ref["id"] = attributeOr(element, "id", "");
+    return ref;
+  }
+  if (tag == "transform") {
+    // Mitsuba expects transform objects, these are created on the Python side
+    nb::dict transform;
+    transform["type"] = "transform";
+    for (const auto &op : element.children) {
+      if (op.name == "matrix") {
+        transform["matrix"] = parseNumbers(attributeOr(op, "value", ""));
+      } else if (op.name == "lookat") {
+        nb::dict lookAt;
+        for (const char *key : {"origin", "target", "up"}) {
+          lookAt[key] = parseNumbers(attributeOr(op, key, ""));
+        }
+        transform["look_at"] = lookAt;
+      }
+    }
+    return transform;
+  }
+
+  nb::dict object;
+  object["type"] = attributeOr(element, "type", tag);
+  addChildren(object, element.children);
+  return object;
+}
+
+// read-only array viewing scene memory, `owner` keeps the scene alive
+template <typename T>
+nb::object view(const T *data, size_t rows, size_t columns, int64_t rowStride,
+                nb::handle owner) {
+  size_t shape[2] = {rows, columns};
+  int64_t strides[2] = {rowStride, 1};
+  return nb::cast(nb::ndarray<nb::numpy, const T, nb::ndim<2>>(
+      const_cast<T *>(data), 2, shape, owner, strides));
+}
+
+nb::dict loadScene(const std::string &inputFile, const Kontsuba::Options &options) {
+  std::shared_ptr<Kontsuba::Scene> scene;
+  {
+    nb::gil_scoped_release release;
+    scene = Kontsuba::loadScene(inputFile, options);
+  }
+  nb::capsule owner(new std::shared_ptr<Kontsuba::Scene>(scene), [](void *p) noexcept {
+    delete static_cast<std::shared_ptr<Kontsuba::Scene> *>(p);
+  });
+
+  nb::dict dict;
+  dict["type"] = "scene";
+  addChildren(dict, scene->elements());
+
+  for (size_t i = 0; i < scene->meshes().size(); i++) {
+    const Kontsuba::MeshView &mesh = scene->meshes()[i];
+    nb::dict shape;
+    shape["type"] = "mesh";
+    shape["name"] = mesh.name;
+    shape["vertex_positions"] = view(mesh.positions, mesh.vertexCount, 3, 3, owner);
+    if (mesh.normals) {
+      shape["vertex_normals"] = view(mesh.normals, mesh.vertexCount, 3, 3, owner);
+    }
+    if (mesh.texcoords) {
+      // u and v of Assimp's three component texture coordinates
+      shape["vertex_texcoords"] = view(mesh.texcoords, mesh.vertexCount, 2, 3, owner);
+    }
+    shape["faces"] = view(mesh.indices.data(), mesh.indices.size() / 3, 3, 3, owner);
+
+    nb::dict bsdf;
+    bsdf["type"] = "ref";
+    bsdf["id"] = mesh.material;
+    shape["bsdf"] = bsdf;
+
+    nb::list transforms;
+    for (const auto &matrix : mesh.transforms) {
+      nb::list values;
+      for (float value : matrix) {
+        values.append(value);
+      }
+      transforms.append(values);
+    }
+    shape["to_world"] = transforms;
+    dict[("mesh" + std::to_string(i)).c_str()] = shape;
+  }
+  return dict;
+}
+
+} // namespace
+
 NB_MODULE(kontsuba_ext, m) {
+  nb::enum_<Kontsuba::MeshFormat>(m, "MeshFormat")
+      .value("Ply", Kontsuba::MeshFormat::Ply)
+      .value("Serialized", Kontsuba::MeshFormat::Serialized);
+
+  nb::enum_<Kontsuba::LinkMode>(m, "LinkMode")
+      .value("Copy", Kontsuba::LinkMode::Copy)
+      .value("Hardlink", Kontsuba::LinkMode::Hardlink)
+      .value("Symlink", Kontsuba::LinkMode::Symlink)
+      .value("Reflink", Kontsuba::LinkMode::Reflink);
+
+  nb::enum_<Kontsuba::TextureFormat>(m, "TextureFormat")
+      .value("Original", Kontsuba::TextureFormat::Original)
+      .value("Exr", Kontsuba::TextureFormat::Exr)
+      .value("Rgbe", Kontsuba::TextureFormat::Rgbe);
+
+  nb::class_<Kontsuba::PostProcessing>(m, "PostProcessing")
+      .def(nb::init<>())
+      .def_static("fast", &Kontsuba::PostProcessing::fast)
+      .def_rw("join_identical_vertices",
+              &Kontsuba::PostProcessing::joinIdenticalVertices)
+      .def_rw("find_degenerates", &Kontsuba::PostProcessing::findDegenerates)
+      .def_rw("fix_infacing_normals",
+              &Kontsuba::PostProcessing::fixInfacingNormals)
+      .def_rw("flip_uvs", &Kontsuba::PostProcessing::flipUVs)
+      .def_rw("transform_uv_coords",
+              &Kontsuba::PostProcessing::transformUVCoords);
+
+  nb::class_<Kontsuba::Options>(m, "Options")
+      .def(nb::init<>())
+      .def_rw("mesh_format", &Kontsuba::Options::meshFormat)
+      .def_rw("jobs", &Kontsuba::Options::jobs)
+      .def_rw("texture_jobs", &Kontsuba::Options::textureJobs)
+      .def_rw("memory_budget", &Kontsuba::Options::memoryBudget)
+      .def_rw("memory_map_input", &Kontsuba::Options::memoryMapInput)
+      .def_rw("fast_obj", &Kontsuba::Options::fastObj)
+      .def_rw("instancing", &Kontsuba::Options::instancing)
+      .def_rw("post_processing", &Kontsuba::Options::postProcessing)
+      .def_rw("time_post_processing", &Kontsuba::Options::timePostProcessing)
+      .def_rw("remove_duplicate_faces", &Kontsuba::Options::removeDuplicateFaces)
+      .def_rw("merge_meshes", &Kontsuba::Options::mergeMeshes)
+      .def_rw("merge_max_vertices", &Kontsuba::Options::mergeMaxVertices)
+      .def_rw("max_faces_per_shape", &Kontsuba::Options::maxFacesPerShape)
+      .def_rw("optimize_mesh_order", &Kontsuba::Options::optimizeMeshOrder)
+      .def_rw("texture_links", &Kontsuba::Options::textureLinks)
+      .def_rw("texture_format", &Kontsuba::Options::textureFormat)
+      .def_rw("texture_max_resolution", &Kontsuba::Options::textureMaxResolution)
+      .def_rw("print_stats", &Kontsuba::Options::printStats)
+      .def_rw("write_stats_json", &Kontsuba::Options::writeStatsJson)
+      .def_rw("cache_directory", &Kontsuba::Options::cacheDirectory)
+      .def_rw("cache_hardlinks", &Kontsuba::Options::cacheHardlinks);
+
+  nb::class_<Kontsuba::BatchResult>(m, "BatchResult")
+      .def_ro("input_file", &Kontsuba::BatchResult::inputFile)
+      .def_ro("output_directory", &Kontsuba::BatchResult::outputDirectory)
+      .def_ro("success", &Kontsuba::BatchResult::success)
+      .def_ro("error", &Kontsuba::BatchResult::error)
+      .def_ro("seconds", &Kontsuba::BatchResult::seconds);
+
+  // the GIL is released while converting so Python threads can overlap
+  // conversions
   m.def(
       "convert",
-      [](const std::string &inputFile, const std::string &outputDirectory) {
-        Kontsuba::convert(inputFile, outputDirectory);
+      [](const std::string &inputFile, const std::string &outputDirectory,
+         const Kontsuba::Options &options) {
+        nb::gil_scoped_release release;
+        Kontsuba::convert(inputFile, outputDirectory, options);
+      },
+      "inputFile"_a, "outputDirectory"_a, "options"_a = Kontsuba::Options());
+
+  m.def(
+      "convert_many",
+      [](const std::vector<std::pair<std::string, std::string>> &models,
+         const Kontsuba::Options &options, nb::object onResult) {
+        std::function<void(const Kontsuba::BatchResult &)> callback;
+        if (!onResult.is_none()) {
+          callback = [&onResult](const Kontsuba::BatchResult &result) {
+            nb::gil_scoped_acquire acquire;
+            onResult(result);
+          };
+        }
+        nb::gil_scoped_release release;
+        return Kontsuba::convertMany(models, options, callback);
       },
-      "inputFile"_a, "outputDirectory"_a);
+      "models"_a, "options"_a = Kontsuba::Options(), "on_result"_a = nb::none(),
+      "Convert a list of (input file, output directory) pairs on "
+      "options.jobs threads. Returns a BatchResult per model; on_result is "
+      "called with each result as soon as it is available.");
+
+  m.def("load_scene", &loadScene, "inputFile"_a, "options"_a = Kontsuba::Options(),
+        "Convert a model in memory. Returns a dict in Mitsuba's scene format "
+        "whose meshes hold NumPy arrays viewing the converter's buffers; "
+        "kontsuba.load_dict turns it into a dict for mitsuba.load_dict. "
+        "Embedded textures are written to a temporary directory that is "
+        "removed once these arrays are released.");
 }
\ No newline at end of file
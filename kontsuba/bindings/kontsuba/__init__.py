@@ -1 +1,77 @@
-from .kontsuba_ext import convert
\ No newline at end of file
+from .kontsuba_ext import (BatchResult, LinkMode, MeshFormat, Options,
+                           PostProcessing, TextureFormat, convert, convert_many,
+                           load_scene)
+
+
+def _transform(mi, value):
+    if "matrix" in value:
+        m = value["matrix"]
+        return mi.ScalarTransform4f([m[0:4], m[4:8], m[8:12], m[12:16]])
+    return mi.ScalarTransform4f().look_at(**value["look_at"])
+
+
+def _resolve(mi, value):
+    # replace the transform descriptions of load_scene by Mitsuba transforms
+    if isinstance(value, dict):
+        if value.get("type") == "transform":
+            return _transform(mi, value)
+        return {key: _resolve(mi, item) for key, item in value.items()}
+    return value
+
+
+def _mesh(mi, shape, bsdf):
+    import numpy as np
+
+    props = mi.Properties()
+    props["bsdf"] = bsdf
+    mesh = mi.Mesh(shape["name"],
+                   len(shape["vertex_positions"]),
+                   len(shape["faces"]),
+                   props,
+                   has_vertex_normals="vertex_normals" in shape,
+                   has_vertex_texcoords="vertex_texcoords" in shape)
+    params = mi.traverse(mesh)
+    params["vertex_positions"] = mi.Float(np.ravel(shape["vertex_positions"]))
+    if "vertex_normals" in shape:
+        params["vertex_normals"] = mi.Float(np.ravel(shape["vertex_normals"]))
+    if "vertex_texcoords" in shape:
+        params["vertex_texcoords"] = mi.Float(np.ravel(shape["vertex_texcoords"]))
+    params["faces"] = mi.UInt32(np.ravel(shape["faces"]))
+    params.update()
+    return mesh
+
+
+def load_dict(input_file, options=None):
+    """Convert `input_file` into a dict for mitsuba.load_dict without writing
+    any files. A Mitsuba variant must be set. Mesh data is copied once, from
+    the converter's buffers into Mitsuba's."""
+    import mitsuba as mi
+
+    scene = load_scene(input_file, options if options is not None else Options())
+    shapes = {key: scene.pop(key) for key in list(scene)
+              if isinstance(scene[key], dict) and scene[key].get("type") == "mesh"}
+    result = _resolve(mi, scene)
+
+    bsdfs = {}
+    identity = [1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0]
+    for key, shape in shapes.items():
+        material = shape["bsdf"]["id"]
+        if material not in bsdfs:
+            bsdfs[material] = mi.load_dict(result.pop(material))
+            result[material] = bsdfs[material]
+        mesh = _mesh(mi, shape, bsdfs[material])
+
+        transforms = shape["to_world"]
+        if len(transforms) == 1 and transforms[0] == identity:
+            result[key] = mesh
+            continue
+        # placed meshes are referenced through a shapegroup
+        result[key] = {"type": "shapegroup", "mesh": mesh}
+        for i, matrix in enumerate(transforms):
+            result[f"{key}_instance{i}"] = {
+                "type": "instance",
+                "shapegroup": {"type": "ref", "id": key},
+                "to_world": _transform(mi, {"matrix": matrix}),
+            }
+    return result
@@ -0,0 +1,129 @@
+#include "cache.h"
+
+#include <fstream>
+#include <random>
+#include <set>
+#include <system_error>
+
+#include "files.h"
+#include "hash.h"
+
+namespace Kontsuba {
+namespace fs = std::filesystem;
+
+namespace {
+
+// bump whenever the output of a conversion changes for identical inputs
+constexpr const char *kCacheVersion = "kontsuba-cache-2";
+
+// Every option that changes the converted files must be hashed here, options
+// that only affect how the conversion runs (e.g. jobs) must not.
+void hashOptions(Hasher &hasher, const Options &options) {
+  hasher.update(options.meshFormat);
+  hasher.update(options.instancing);
+  hasher.update(options.fastObj);
+  const PostProcessing &pp = options.postProcessing;
+  hasher.update(pp.joinIdenticalVertices);
+  hasher.update(pp.findDegenerates);
+  hasher.update(pp.fixInfacingNormals);
+  hasher.update(pp.flipUVs);
+  hasher.update(pp.transformUVCoords);
+  hasher.update(options.removeDuplicateFaces);
+  hasher.update(options.mergeMeshes);
+  hasher.update(options.mergeMaxVertices);
+  hasher.update(options.maxFacesPerShape);
+  hasher.update(options.optimizeMeshOrder);
+  hasher.update(options.textureFormat);
+  hasher.update(options.textureMaxResolution);
+}
+
+} // namespace
+
+OutputCache::OutputCache(const fs::path &cacheDirectory, bool hardlinks)
+    : m_cacheDirectory(cacheDirectory), m_hardlinks(hardlinks) {
+  fs::create_directories(m_cacheDirectory);
+}
+
+std::string OutputCache::key(const fs::path &inputFile, const Options &options) const {
+  Hasher hasher;
+  hasher.update(std::string(kCacheVersion));
+  hashFile(hasher, inputFile);
+  // the relative location of referenced files depends on the file name
+  hasher.update(inputFile.filename().string());
+  hashOptions(hasher, options);
+  return hasher.hexdigest();
+}
+
+bool OutputCache::restore(const std::string &key, const fs::path &outputDirectory) const {
+  auto entry = m_cacheDirectory / key;
+  std::ifstream manifest(entry / "manifest.txt");
+  if (manifest.fail()) {
+    return false;
+  }
+
+  // manifest lines are "dep <hash> <path>" or "out <path>"
+  std::vector<fs::path> files;
+  std::string kind;
+  while (manifest >> kind) {
+    std::string hash, path;
+    if (kind == "dep") {
+      manifest >> hash;
+    }
+    manifest.get(); // separator
+    std::getline(manifest, path);
+    if (kind == "dep") {
+      std::error_code error;
+      if (!fs::exists(path, error) || hashFile(path) != hash) {
+        return false;
+      }
+    } else {
+      files.emplace_back(path);
+    }
+  }
+
+  for (const auto &file : files) {
+    transfer(entry / "output" / file, outputDirectory / file);
+  }
+  return true;
+}
+
+void OutputCache::store(const std::string &key, const fs::path &outputDirectory,
+                        const std::vector<fs::path> &files,
+                        const std::vector<fs::path> &dependencies) const {
+  // populate a private staging directory and move it into place at the end,
+  // so that concurrent conversions never observe a partial entry
+  std::random_device rd;
+  auto staging = m_cacheDirectory / fmt::format("{}.tmp{}", key, rd());
+  fs::create_directories(staging / "output");
+
+  {
+    std::ofstream manifest(staging / "manifest.txt");
+    std::set<fs::path> unique(dependencies.begin(), dependencies.end());
+    for (const auto &dependency : unique) {
+      manifest << "dep " << hashFile(dependency) << " " << dependency.string() << "\n";
+    }
+    for (const auto &file : std::set<fs::path>(files.begin(), files.end())) {
+      manifest << "out " << file.generic_string() << "\n";
+      transfer(outputDirectory / file, staging / "output" / file);
+    }
+    if (manifest.fail()) {
+      throw std::runtime_error("failed to write cache entry " + staging.string());
+    }
+  }
+
+  auto entry = m_cacheDirectory / key;
+  std::error_code error;
+  fs::remove_all(entry, error);
+  fs::rename(staging, entry, error);
+  if (error) {
+    // somebody else stored the same entry in the meantime
+    fs::remove_all(staging, error);
+  }
+}
+
+void OutputCache::transfer(const fs::path &from, const fs::path &to) const {
+  fs::create_directories(to.parent_path());
+  transferFile(from, to, m_hardlinks ? LinkMode::Hardlink : LinkMode::Copy);
+}
+
+} // namespace Kontsuba
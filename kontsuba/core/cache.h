@@ -0,0 +1,39 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "converter.h"
+
+namespace Kontsuba {
+
+// Content addressed store of previous conversion results.
+//
+// An entry is keyed on the contents of the input file and the options that
+// influence the output. Next to the converted files each entry records the
+// hashes of all other files the conversion read (material libraries,
+// textures, ...), and is only reused if none of them changed.
+class OutputCache {
+public:
+  OutputCache(const std::filesystem::path &cacheDirectory, bool hardlinks);
+
+  std::string key(const std::filesystem::path &inputFile, const Options &options) const;
+
+  // Materialize the entry for `key` into `outputDirectory`. Returns false if
+  // there is no entry or one of its dependencies changed.
+  bool restore(const std::string &key, const std::filesystem::path &outputDirectory) const;
+
+  // Record `files` (relative to `outputDirectory`) as the result for `key`.
+  void store(const std::string &key, const std::filesystem::path &outputDirectory,
+             const std::vector<std::filesystem::path> &files,
+             const std::vector<std::filesystem::path> &dependencies) const;
+
+private:
+  void transfer(const std::filesystem::path &from, const std::filesystem::path &to) const;
+
+  std::filesystem::path m_cacheDirectory;
+  bool m_hardlinks;
+};
+
+} // namespace Kontsuba
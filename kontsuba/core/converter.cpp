@@ -1,32 +1,49 @@
 #include "converter.h"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <random>
+#include <set>
 #include <string>
-#include <unordered_set>
+#include <system_error>
 #include <vector>
 
 #include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
 #include <assimp/scene.h>
-#include <tinyply.h>
-#include <tinyxml2.h>
 #include <fmt/core.h>
+#include "cache.h"
+#include "files.h"
+#include "hash.h"
+#include "import.h"
+#include "io_system.h"
+#include "mesh_processing.h"
+#include "ply.h"
 #include "principled_brdf.h"
+#include "scene_elements.h"
+#include "serialized.h"
+#include "stats.h"
+#include "texture_processing.h"
+#include "thread_pool.h"
 #include "utils.h"
+#include "xml_writer.h"
 
 namespace Kontsuba {
-using namespace tinyxml2;
 namespace fs = std::filesystem;
 
 class Converter {
 public:
-  Converter(const std::string &inputFile,
-                 const std::string &outputDirectory)
+  Converter(Assimp::Importer &importer,
+                 const std::string &inputFile,
+                 const std::string &outputDirectory,
+                 const Options &options)
       : m_inputFile(inputFile), m_outputDirectory(outputDirectory),
-        m_importer(), m_xmlDoc() {
+        m_options(options), m_importer(importer) {
     m_fromDir = fs::canonical(expand(inputFile));
     if (!fs::is_directory(m_fromDir)) {
       m_fromDir = m_fromDir.parent_path();
@@ -37,320 +54,683 @@ public:
     m_outputMeshPath = m_outputDirectory / "meshes";
     m_outputTexturePath = m_outputDirectory / "textures";
     m_outputSceneDescPath = m_outputDirectory / "scene.xml";
-
-    m_xmlRoot = m_xmlDoc.NewElement("scene");
-    m_xmlRoot->SetAttribute("version", "3.0.0");
-    m_xmlDoc.InsertFirstChild(m_xmlRoot);
   }
 
   void convert();
 
 private:
-  XMLElement *defaultIntegrator();
-  XMLElement *defaultSensor();
-  XMLElement *defaultLighting();
-  XMLElement *materialToBSDFNode(const aiMaterial *material);
-  void writeMeshPly(const aiMesh *mesh, const std::string &path, bool removeDuplicateFaces = false);
-
-  auto constructNode(const std::string &type, const std::string &name,
-                     const std::string &value) {
-    tinyxml2::XMLElement *node = m_xmlDoc.NewElement(type.c_str());
-    node->SetAttribute("name", name.c_str());
-    node->SetAttribute("value", value.c_str());
-    return node;
-  }
-
-  Assimp::Importer m_importer;
-  XMLDocument m_xmlDoc;
-  XMLElement *m_xmlRoot;
+  void convertOrRestore();
+  void reportStats() const;
+  void convertScene();
+  void unlinkSharedOutputs();
+  std::map<std::pair<Texture, bool>, std::string>
+  placeTextures(const aiScene *scene, const std::vector<PrincipledBRDF> &brdfs,
+                ThreadPool &pool, std::vector<std::future<uint64_t>> &transfers);
+  std::vector<uint32_t> meshIndices(const aiMesh *mesh) const;
+  // estimated memory needed to export `mesh`, counted against the budget
+  uint64_t exportBytes(const aiMesh *mesh) const;
+  // .ply file of `chunk` out of the `chunks` mesh `mesh` was split into
+  static std::string meshFilename(size_t mesh, uint32_t chunk, uint32_t chunks);
+
+  Options m_options;
+  Assimp::Importer &m_importer;
   fs::path m_inputFile;
   fs::path m_fromDir;
   fs::path m_outputDirectory;
   fs::path m_outputMeshPath;
   fs::path m_outputTexturePath;
   fs::path m_outputSceneDescPath;
+
+  // output files relative to m_outputDirectory and the files read besides
+  // the input, used to populate the output cache
+  std::vector<fs::path> m_outputFiles;
+  std::vector<fs::path> m_dependencies;
+
+  ConversionStats m_stats;
 };
 
-XMLElement *Converter::defaultIntegrator() {
-  auto integrator = m_xmlDoc.NewElement("integrator");
-  integrator->SetAttribute("type", "path");
-  auto maxDepthNode = constructNode("integer", "max_depth", "3");
-  integrator->InsertEndChild(maxDepthNode);
-  return integrator;
+std::string Converter::meshFilename(size_t mesh, uint32_t chunk, uint32_t chunks) {
+  if (chunks == 1) {
+    return "mesh" + std::to_string(mesh) + ".ply";
+  }
+  return "mesh" + std::to_string(mesh) + "-" + std::to_string(chunk) + ".ply";
 }
 
-XMLElement *Converter::defaultLighting() {
-  auto emitterNode = m_xmlDoc.NewElement("emitter");
-  emitterNode->SetAttribute("type", "point");
-  auto intensityNode = constructNode("rgb", "intensity", "10");
-  emitterNode->InsertEndChild(intensityNode);
-  auto positionNode = constructNode("point", "position", "2, 2, 2");
-  emitterNode->InsertEndChild(positionNode);
-  return emitterNode;
+std::vector<uint32_t> Converter::meshIndices(const aiMesh *mesh) const {
+  auto indices = triangleIndices(mesh);
+  if (m_options.removeDuplicateFaces) {
+    removeDuplicateFaces(mesh, indices);
+  }
+  return indices;
 }
 
-XMLElement *Converter::defaultSensor() {
-  auto sensorNode = m_xmlDoc.NewElement("sensor");
-  sensorNode->SetAttribute("type", "perspective");
-  auto fovNode = constructNode("float", "fov", "45");
-  sensorNode->InsertEndChild(fovNode);
-  auto toWorldNode = m_xmlDoc.NewElement("transform");
-  toWorldNode->SetAttribute("name", "to_world");
-  auto lookAtNode = m_xmlDoc.NewElement("lookat");
-  lookAtNode->SetAttribute("origin", "1, 1, 0");
-  lookAtNode->SetAttribute("target", "0, 0, 0");
-  lookAtNode->SetAttribute("up", "0, 0, 1");
-  toWorldNode->InsertEndChild(lookAtNode);
-  sensorNode->InsertEndChild(toWorldNode);
-
-  auto samplerNode = m_xmlDoc.NewElement("sampler");
-  samplerNode->SetAttribute("type", "independent");
-  auto sampleCountNode = constructNode("integer", "sample_count", "32");
-  samplerNode->InsertEndChild(sampleCountNode);
-  sensorNode->InsertEndChild(samplerNode);
-
-  auto filmNode = m_xmlDoc.NewElement("film");
-  filmNode->SetAttribute("type", "hdrfilm");
-  auto widthNode = constructNode("integer", "width", "512");
-  filmNode->InsertEndChild(widthNode);
-  auto heightNode = constructNode("integer", "height", "512");
-  filmNode->InsertEndChild(heightNode);
-  auto pixelFormatNode = constructNode("string", "pixel_format", "rgb");
-  filmNode->InsertEndChild(pixelFormatNode);
-  sensorNode->InsertEndChild(filmNode);
-
-  return sensorNode;
+uint64_t Converter::exportBytes(const aiMesh *mesh) const {
+  uint64_t vertexBytes = uint64_t(mesh->mNumVertices) * sizeof(aiVector3D);
+  vertexBytes += mesh->HasNormals() ? vertexBytes : 0;
+  vertexBytes += mesh->HasTextureCoords(0) ? vertexBytes : 0;
+  uint64_t indexBytes = uint64_t(mesh->mNumFaces) * 3 * sizeof(uint32_t);
+  // the flat indices, a reordered or split copy of the mesh and the
+  // compressed serialized shape, which at worst is as large as the mesh
+  uint64_t bytes = indexBytes;
+  if (m_options.optimizeMeshOrder || m_options.maxFacesPerShape != 0) {
+    bytes += vertexBytes + indexBytes;
+  }
+  if (m_options.meshFormat == MeshFormat::Serialized) {
+    bytes += vertexBytes + indexBytes;
+  }
+  return bytes;
 }
 
-void Converter::writeMeshPly(const aiMesh *mesh,
-                             const std::string &filename,
-                             bool removeDuplicateFaces) {
-                                    
-  std::filebuf fb_binary;
-  fb_binary.open(filename, std::ios::out | std::ios::binary);
-  std::ostream outstream_binary(&fb_binary);
-  if (outstream_binary.fail()) {
-    throw std::runtime_error("failed to open " + filename);
-  }
+void Converter::convert() {
+  m_stats.inputFile = m_inputFile.string();
+  convertOrRestore();
+  reportStats();
+}
 
-  tinyply::PlyFile meshFile;
-  std::vector<aiVector3D> vertices;
-  std::vector<aiVector3D> normals;
-  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-    vertices.push_back(
-        {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z});
-    if (mesh->HasNormals()) {
-      normals.push_back(
-          {mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z});
-    }
+void Converter::convertOrRestore() {
+  if (m_options.cacheDirectory.empty()) {
+    ScopedIOHandler handler(m_importer, inputIOSystem(m_options).release());
+    convertScene();
+    return;
   }
 
-  std::vector<uint32_t> indices;
-  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-    const aiFace &face = mesh->mFaces[i];
-    auto numIndices = face.mNumIndices;
-    if (numIndices != 3) {
-      throw std::runtime_error("only triangles are supported. Number of Vertices: " +
-        std::to_string(numIndices) + " in Mesh: " + mesh->mName.C_Str());
-    }
-    for (unsigned int j = 0; j < numIndices; j++) {
-      indices.push_back(face.mIndices[j]);
-    }
+  OutputCache cache(expand(m_options.cacheDirectory), m_options.cacheHardlinks);
+  PhaseTimer lookup(m_stats, "cache lookup");
+  auto key = cache.key(m_inputFile, m_options);
+  if (cache.restore(key, m_outputDirectory)) {
+    m_stats.cached = true;
+    return;
   }
+  lookup.stop();
 
-  if (removeDuplicateFaces) {
-    using FaceData = std::tuple<uint32_t, uint32_t, uint32_t>; // indices
+  if (m_options.cacheHardlinks) {
+    unlinkSharedOutputs();
+  }
 
-    std::vector<FaceData> faces;
-    for (int i = 0; i < indices.size(); i += 3) {
-      faces.push_back({indices[i], indices[i + 1], indices[i + 2]});
+  {
+    // record every file the importer reads
+    auto recorder = new RecordingIOSystem(inputIOSystem(m_options));
+    ScopedIOHandler handler(m_importer, recorder);
+    convertScene();
+    for (const auto &file : recorder->openedFiles()) {
+      m_dependencies.emplace_back(file);
     }
+  }
 
-    auto equal = [&](const FaceData &f1, const FaceData &f2) {
-      float epsilon = 0.0001f;
-      auto [i1, i2, i3] = f1;
-      auto [j1, j2, j3] = f2;
-
-      // get vertices from indices
-      auto v1 = vertices[i1];
-      auto v2 = vertices[i2];
-      auto v3 = vertices[i3];
+  PhaseTimer store(m_stats, "cache store");
+  cache.store(key, m_outputDirectory, m_outputFiles, m_dependencies);
+}
 
-      auto w1 = vertices[j1];
-      auto w2 = vertices[j2];
-      auto w3 = vertices[j3];
+void Converter::reportStats() const {
+  if (m_options.printStats) {
+    // a single write keeps reports of concurrent batch conversions apart
+    std::cout << m_stats.summary() << std::flush;
+  }
+  if (m_options.writeStatsJson) {
+    // written outside the cached outputs so it always describes this run
+    std::ofstream file(m_outputDirectory / "stats.json", std::ios::binary);
+    file << m_stats.json();
+    if (file.fail()) {
+      throw std::runtime_error("failed to write " +
+                               (m_outputDirectory / "stats.json").string());
+    }
+  }
+}
 
-      auto test = [=](const aiVector3D &v, const aiVector3D &w) {
-        return abs(v.x - w.x) < epsilon && abs(v.y - w.y) < epsilon &&
-              abs(v.z - w.z) < epsilon;
-      };
+void Converter::unlinkSharedOutputs() {
+  // files restored from the cache as hardlinks share their contents with the
+  // cache entry and must not be overwritten in place
+  std::error_code error;
+  auto unlinkIfShared = [&](const fs::path &path) {
+    if (fs::is_regular_file(path, error) && fs::hard_link_count(path, error) > 1) {
+      fs::remove(path, error);
+    }
+  };
+  unlinkIfShared(m_outputSceneDescPath);
+  for (const auto &directory : {m_outputMeshPath, m_outputTexturePath}) {
+    if (!fs::is_directory(directory, error)) {
+      continue;
+    }
+    for (const auto &entry : fs::directory_iterator(directory, error)) {
+      unlinkIfShared(entry.path());
+    }
+  }
+}
 
-      // test distance smaller than epsilon for every permutation (3! = 6)
-      if (test(v1, w1) && test(v2, w2) && test(v3, w3)) {
-        return true;
-      }
-      if (test(v1, w1) && test(v2, w3) && test(v3, w2)) {
-        return true;
-      }
-      if (test(v1, w2) && test(v2, w1) && test(v3, w3)) {
-        return true;
+std::map<std::pair<Texture, bool>, std::string>
+Converter::placeTextures(const aiScene *scene, const std::vector<PrincipledBRDF> &brdfs,
+                         ThreadPool &pool, std::vector<std::future<uint64_t>> &transfers) {
+  const bool transcode = m_options.textureFormat != TextureFormat::Original;
+
+  // Distinct (source file, raw) pairs in order of first use. Normal and bump
+  // maps are raw data, the distinction only matters for transcoded textures
+  // since their colors are converted to linear values.
+  std::vector<TextureSource> sources;
+  std::vector<bool> transcodable;
+  std::vector<std::pair<size_t, bool>> uses;
+  std::map<std::pair<Texture, bool>, size_t> useOf;
+  for (const auto &brdf : brdfs) {
+    for (const auto &texture : brdf.textures) {
+      // embedded textures are referenced as "*N" or by their original name
+      TextureSource source;
+      auto [embedded, embeddedIndex] = scene->GetEmbeddedTextureAndIndex(texture.c_str());
+      if (embedded) {
+        source.embedded = embedded;
+        source.path = embeddedTextureName(embedded, embeddedIndex);
+      } else {
+        source.path = (m_fromDir / texture).lexically_normal();
       }
-      if (test(v1, w2) && test(v2, w3) && test(v3, w1)) {
-        return true;
+      size_t index = std::find_if(sources.begin(), sources.end(),
+                                  [&](const TextureSource &other) {
+                                    return other.embedded == source.embedded &&
+                                           other.path == source.path;
+                                  }) -
+                     sources.begin();
+      if (index == sources.size()) {
+        sources.push_back(source);
+        transcodable.push_back(transcode && canTranscode(source));
+        if (!embedded) {
+          m_dependencies.push_back(source.path);
+        }
       }
-      if (test(v1, w3) && test(v2, w1) && test(v3, w2)) {
-        return true;
+      bool rawUse = texture == brdf.normalMap || texture == brdf.bumpMap;
+      bool colorUse = !rawUse || texture == brdf.base_color.texture ||
+                      texture == brdf.metallic.texture || texture == brdf.roughness.texture;
+      for (bool raw : {false, true}) {
+        if (!(raw ? rawUse : colorUse)) {
+          continue;
+        }
+        auto use = std::make_pair(index, transcodable[index] && raw);
+        size_t useIndex = std::find(uses.begin(), uses.end(), use) - uses.begin();
+        if (useIndex == uses.size()) {
+          uses.push_back(use);
+        }
+        useOf[{texture, raw}] = useIndex;
       }
-      if (test(v1, w3) && test(v2, w2) && test(v3, w1)) {
-        return true;
-      }
-
-      return false;
-    };
-
-    auto hash = [&](const FaceData &f) {
-      auto [i1, i2, i3] = f;
-      auto v1 = vertices[i1];
-      auto v2 = vertices[i2];
-      auto v3 = vertices[i3];
-
-      return std::hash<float>()(v1.x) ^ std::hash<float>()(v1.y) ^
-            std::hash<float>()(v1.z) ^ std::hash<float>()(v2.x) ^
-            std::hash<float>()(v2.y) ^ std::hash<float>()(v2.z) ^
-            std::hash<float>()(v3.x) ^ std::hash<float>()(v3.y) ^
-            std::hash<float>()(v3.z);
-    };
-
-    using FaceSet = std::unordered_set<FaceData, decltype(hash), decltype(equal)>;
-    FaceSet faceSet(faces.begin(), faces.end(), 0, hash, equal);
-
-    std::vector<uint32_t> uniqueIndices;
-    for (const auto &face : faceSet) {
-      auto [i1, i2, i3] = face;
-      uniqueIndices.push_back(i1);
-      uniqueIndices.push_back(i2);
-      uniqueIndices.push_back(i3);
     }
-    indices = uniqueIndices;
   }
 
-  meshFile.add_properties_to_element(
-      "vertex", {"x", "y", "z"}, tinyply::Type::FLOAT32, mesh->mNumVertices,
-      reinterpret_cast<uint8_t *>(vertices.data()), tinyply::Type::INVALID, 0);
-
-  if (mesh->HasNormals()) {
-    meshFile.add_properties_to_element(
-        "vertex", {"nx", "ny", "nz"}, tinyply::Type::FLOAT32,
-        mesh->mNumVertices, reinterpret_cast<uint8_t *>(normals.data()),
-        tinyply::Type::INVALID, 0);
+  // only files of equal size can be duplicates and need to be hashed
+  std::vector<uintmax_t> sizes;
+  std::map<uintmax_t, size_t> sizeCounts;
+  for (const auto &source : sources) {
+    sizes.push_back(textureSize(source));
+    sizeCounts[sizes.back()]++;
   }
-
-  std::vector<aiVector2D>
-      texCoords; // this needs to be in the same scope as meshFile
-  if (mesh->HasTextureCoords(0)) {
-    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-      texCoords.push_back(
-          {mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y});
+  std::vector<std::future<std::string>> hashing(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (sizeCounts[sizes[i]] > 1) {
+      hashing[i] = pool.submit([source = sources[i]] { return hashTexture(source); });
+    }
+  }
+  std::vector<std::string> hashes(sources.size());
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (hashing[i].valid()) {
+      hashes[i] = hashing[i].get();
     }
-    meshFile.add_properties_to_element(
-        "vertex", {"u", "v"}, tinyply::Type::FLOAT32, mesh->mNumVertices,
-        reinterpret_cast<uint8_t *>(texCoords.data()), tinyply::Type::INVALID,
-        0);
   }
+  auto hashOf = [&](size_t source) -> const std::string & {
+    if (hashes[source].empty()) {
+      hashes[source] = hashTexture(sources[source]);
+    }
+    return hashes[source];
+  };
+
+  // every distinct content is placed once, the transfers run in the background
+  std::vector<std::string> placedAs(uses.size());
+  std::set<std::string> usedNames;
+  for (size_t i = 0; i < uses.size(); i++) {
+    auto [source, raw] = uses[i];
+    for (size_t other = 0; other < i; other++) {
+      auto [otherSource, otherRaw] = uses[other];
+      // the hash only finds candidates, equal contents are confirmed
+      if (otherRaw == raw && sizes[otherSource] == sizes[source] &&
+          hashes[otherSource] == hashes[source] &&
+          (otherSource == source || sameContents(sources[otherSource], sources[source]))) {
+        placedAs[i] = placedAs[other];
+        break;
+      }
+    }
+    if (!placedAs[i].empty()) {
+      continue;
+    }
+
+    const fs::path &path = sources[source].path;
+    std::string extension = transcodable[source] ? textureExtension(m_options.textureFormat)
+                                                 : path.extension().string();
+    std::string name = path.stem().string() + extension;
+    for (int attempt = 1; !usedNames.insert(name).second; attempt++) {
+      // a different texture (or the raw variant of this one) of the same name
+      name = path.stem().string() + "-" + hashOf(source).substr(0, 8) +
+             (attempt > 1 ? "-" + std::to_string(attempt) : "") + extension;
+    }
 
-  meshFile.add_properties_to_element(
-      "face", {"vertex_indices"}, tinyply::Type::UINT32, indices.size() / 3,
-      reinterpret_cast<uint8_t *>(indices.data()), tinyply::Type::UINT8,
-      3);
+    fs::path target = m_outputTexturePath / name;
+    if (transcodable[source]) {
+      transfers.push_back(pool.submit([source = sources[source], target, raw = raw,
+                                       options = m_options] {
+        try {
+          return transcodeTexture(source, target, options.textureFormat, raw,
+                                  options.textureMaxResolution);
+        } catch (std::exception &e) {
+          std::cout << "Warning: " + std::string(e.what()) + ", keeping the original\n"
+                    << std::flush;
+        }
+        // Mitsuba detects the image format from the contents, not the name
+        return source.embedded ? writeEmbeddedTexture(source.embedded, target)
+                               : transferFile(source.path, target, options.textureLinks);
+      }));
+    } else if (sources[source].embedded) {
+      transfers.push_back(pool.submit([texture = sources[source].embedded, target] {
+        return writeEmbeddedTexture(texture, target);
+      }));
+    } else {
+      transfers.push_back(pool.submit([source = path, target, mode = m_options.textureLinks] {
+        return transferFile(source, target, mode);
+      }));
+    }
+    m_outputFiles.push_back(fs::path("textures") / name);
+    placedAs[i] = "textures/" + name;
+  }
 
-  meshFile.get_comments().push_back("generated by kontsuba");
-  meshFile.write(outstream_binary, true);
+  std::map<std::pair<Texture, bool>, std::string> filenames;
+  for (const auto &[texture, use] : useOf) {
+    filenames[texture] = placedAs[use];
+  }
+  return filenames;
 }
 
-void Converter::convert() {
-  // clang-format off
-  const aiScene *scene = m_importer.ReadFile(m_inputFile.string(),
-    aiProcess_Triangulate           |
-    aiProcess_JoinIdenticalVertices |
-    aiProcess_FindDegenerates       |
-    aiProcess_FixInfacingNormals    |
-    aiProcess_PreTransformVertices  |
-    aiProcess_FlipUVs               |
-    aiProcess_TransformUVCoords     |
-    aiProcess_SortByPType
-  );
-  // clang-format on
-
-  if (!scene) {
-    throw std::runtime_error(m_importer.GetErrorString());
+void Converter::convertScene() {
+  PhaseTimer importTimer(m_stats, "import");
+  std::unique_ptr<aiScene> ownedScene;
+  importScene(m_importer, m_inputFile, m_options, ownedScene);
+  // take the scene from the importer so meshes can be released once written
+  if (!ownedScene) {
+    ownedScene.reset(m_importer.GetOrphanedScene());
   }
+  aiScene *scene = ownedScene.get();
+
+  importTimer.stop();
 
   fs::create_directories(m_outputDirectory);
   fs::create_directories(m_outputMeshPath);
   fs::create_directories(m_outputTexturePath);
 
-  auto integratorNode = defaultIntegrator();
-  auto lightingNode = defaultLighting();
-  auto sensorNode = defaultSensor();
-
-  m_xmlRoot->InsertEndChild(integratorNode);
-  m_xmlRoot->InsertEndChild(lightingNode);
-  m_xmlRoot->InsertEndChild(sensorNode);
-
-  // TODO remove this when we have proper emitter loading
-  auto backgroundNode = m_xmlDoc.NewElement("emitter");
-  backgroundNode->SetAttribute("type", "constant");
-  auto backgroundIntensityNode = constructNode("rgb", "radiance", "1.0");
-  backgroundNode->InsertEndChild(backgroundIntensityNode);
-  m_xmlRoot->InsertEndChild(backgroundNode);
-
-  // loop over all materials in scene
+  // textures are copied on their own workers while the meshes are written
+  PhaseTimer texturesTimer(m_stats, "textures");
+  std::vector<std::future<uint64_t>> textureTransfers;
+  ThreadPool texturePool(m_options.textureJobs);
+  std::vector<PrincipledBRDF> brdfs;
   for (size_t i = 0; i < scene->mNumMaterials; i++) {
-    auto brdf = PrincipledBRDF::fromMaterial(scene->mMaterials[i], true);
-    auto materialNode = toXML(m_xmlDoc, brdf);
-    m_xmlRoot->InsertEndChild(materialNode);
-
-    for(const auto& texture : brdf.textures) {
-      // copy texture to new location
-      fs::copy_file(m_fromDir / texture,
-        m_outputTexturePath / fs::path(texture).filename(),
-        fs::copy_options::overwrite_existing);
+    brdfs.push_back(PrincipledBRDF::fromMaterial(scene->mMaterials[i], true));
+  }
+  auto textureFilenames = placeTextures(scene, brdfs, texturePool, textureTransfers);
+  texturesTimer.stop();
+
+  PhaseTimer materialsTimer(m_stats, "materials");
+  XMLWriter xml(m_outputSceneDescPath.string());
+  xml.open("scene").attribute("version", "3.0.0");
+
+  writeSceneDefaults(xml);
+
+  auto textureFilename = [&](const Texture &texture, bool raw) {
+    return textureFilenames.at({texture, raw});
+  };
+  // identical materials share the bsdf of the first one, shapes refer to
+  // materials by index
+  std::vector<std::string> materialIds;
+  std::map<std::string, std::string> idOfFingerprint;
+  for (const auto &brdf : brdfs) {
+    auto [known, added] =
+        idOfFingerprint.emplace(fingerprint(brdf, textureFilename), brdf.name);
+    if (added) {
+      toXML(xml, brdf, textureFilename);
     }
+    materialIds.push_back(known->second);
   }
+  materialsTimer.stop();
 
-  // loop over all meshes in scene
+  // all meshes share a single file in the serialized format
+  std::optional<SerializedWriter> serializedWriter;
+  std::string serializedSceneFileName = "meshes/meshes.serialized";
+  if (m_options.meshFormat == MeshFormat::Serialized) {
+    serializedWriter.emplace((m_outputDirectory / serializedSceneFileName).string());
+  }
+
+  auto instances = meshInstances(scene, m_options);
+  std::vector<const aiMesh *> meshes(scene->mMeshes, scene->mMeshes + scene->mNumMeshes);
+  std::vector<std::unique_ptr<aiMesh>> mergedMeshes;
+  if (m_options.mergeMeshes) {
+    PhaseTimer mergeTimer(m_stats, "merge meshes");
+    mergedMeshes = mergeMeshes(meshes, instances, materialIds, m_options.mergeMaxVertices);
+  }
+  // meshes that are not written (merged or not placed) are not needed anymore
   for (size_t i = 0; i < scene->mNumMeshes; i++) {
-    aiMesh *mesh = scene->mMeshes[i];
+    if (instances[i].empty() || meshes[i] != scene->mMeshes[i]) {
+      releaseMeshData(scene->mMeshes[i]);
+    }
+  }
 
-    aiString name;
-    auto plyName = m_outputMeshPath / ("mesh" + std::to_string(i) + ".ply");
-    scene->mMaterials[mesh->mMaterialIndex]->Get(AI_MATKEY_NAME, name);
-    std::string plySceneFileName = "meshes/" + plyName.filename().string();
+  // meshes are written concurrently; serialized shapes are only compressed
+  // by the workers and appended to the shared file below. Each mesh yields
+  // one result per chunk it was split into.
+  PhaseTimer meshesTimer(m_stats, "meshes");
+  std::vector<std::future<std::vector<std::vector<char>>>> meshResults(scene->mNumMeshes);
+  // each worker only fills the entry of its own mesh
+  std::vector<MeshStats> meshStats(scene->mNumMeshes);
+  // declared after everything the tasks use so it is joined first, even if
+  // the assembly below throws
+  ThreadPool pool(m_options.jobs);
+  auto submitMesh = [&](size_t i) {
+    const aiMesh *mesh = meshes[i];
+    bool serialized = serializedWriter.has_value();
+    MeshStats *stats = &meshStats[i];
+    meshResults[i] = pool.submit([this, mesh, i, serialized, stats] {
+      auto start = std::chrono::steady_clock::now();
+      auto indices = meshIndices(mesh);
+      stats->name = mesh->mName.C_Str();
+      stats->vertices = mesh->mNumVertices;
+      stats->faces = indices.size() / 3;
+
+      std::vector<std::vector<char>> encoded;
+      auto write = [&](const aiMesh *part, std::vector<uint32_t> &partIndices,
+                       uint32_t chunk) {
+        std::unique_ptr<aiMesh> reordered;
+        if (m_options.optimizeMeshOrder) {
+          stats->cacheMissesBefore += cacheMisses(partIndices, part->mNumVertices);
+          optimizeFaceOrder(partIndices, part->mNumVertices);
+          stats->cacheMissesAfter += cacheMisses(partIndices, part->mNumVertices);
+          reordered = optimizeVertexOrder(part, partIndices);
+          part = reordered.get();
+        }
+        if (serialized) {
+          encoded.push_back(SerializedWriter::encode(part, partIndices));
+          stats->bytesWritten += encoded.back().size();
+        } else {
+          auto plyName = m_outputMeshPath / meshFilename(i, chunk, stats->chunks);
+          writePly(plyName.string(), part, partIndices);
+          encoded.emplace_back();
+          stats->bytesWritten += fs::file_size(plyName);
+        }
+      };
+      if (m_options.maxFacesPerShape == 0 || stats->faces <= m_options.maxFacesPerShape) {
+        write(mesh, indices, 0);
+      } else {
+        // one chunk in memory at a time
+        auto chunks = partitionFaces(mesh, indices, m_options.maxFacesPerShape);
+        indices = std::vector<uint32_t>();
+        stats->chunks = static_cast<uint32_t>(chunks.size());
+        for (uint32_t chunk = 0; chunk < chunks.size(); chunk++) {
+          std::vector<uint32_t> localIndices;
+          auto part = extractChunk(mesh, chunks[chunk], localIndices);
+          chunks[chunk] = std::vector<uint32_t>();
+          write(part.get(), localIndices, chunk);
+        }
+      }
+      // the scene is owned here and every mesh is written once
+      releaseMeshData(const_cast<aiMesh *>(mesh));
+      stats->seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+      return encoded;
+    });
+  };
+
+  // estimated memory of the meshes started but not assembled yet
+  std::vector<uint64_t> meshBytes(scene->mNumMeshes, 0);
+  uint64_t bytesInFlight = 0;
+  size_t nextMesh = 0;
+
+  // assemble the shape nodes in mesh order so the output does not depend on
+  // the number of workers
+  for (size_t i = 0; i < scene->mNumMeshes; i++) {
+    // start the following meshes as far as the budget allows; mesh i is
+    // started regardless so that meshes larger than the budget are written
+    // on their own
+    for (; nextMesh < scene->mNumMeshes; nextMesh++) {
+      if (instances[nextMesh].empty()) {
+        continue;
+      }
+      uint64_t bytes = exportBytes(meshes[nextMesh]);
+      if (nextMesh > i && m_options.memoryBudget != 0 &&
+          bytesInFlight + bytes > m_options.memoryBudget) {
+        break;
+      }
+      meshBytes[nextMesh] = bytes;
+      bytesInFlight += bytes;
+      submitMesh(nextMesh);
+    }
+    if (!meshResults[i].valid()) {
+      continue;
+    }
+    const aiMesh *mesh = meshes[i];
+    const std::string &materialId = materialIds.at(mesh->mMaterialIndex);
 
     try {
-      writeMeshPly(mesh, plyName.string());
-      auto meshNode = m_xmlDoc.NewElement("shape");
-      meshNode->SetAttribute("type", "ply");
-      auto filenameNode =
-          constructNode("string", "filename", plySceneFileName.c_str());
-      meshNode->InsertEndChild(filenameNode);
-      auto refNode = m_xmlDoc.NewElement("ref");
-      refNode->SetAttribute("id", name.C_Str());
-      meshNode->InsertEndChild(refNode);
-
-      m_xmlRoot->InsertEndChild(meshNode);
+      auto encoded = meshResults[i].get();
+      // shape indices of the chunks within the serialized file
+      std::vector<uint32_t> shapeIndices;
+      if (serializedWriter) {
+        for (const auto &chunk : encoded) {
+          shapeIndices.push_back(serializedWriter->append(chunk));
+          if (shapeIndices.back() == 0u) {
+            m_outputFiles.push_back(serializedSceneFileName);
+          }
+        }
+        meshStats[i].file =
+            fmt::format("{}#{}", serializedSceneFileName, shapeIndices.front());
+      } else {
+        for (uint32_t chunk = 0; chunk < encoded.size(); chunk++) {
+          m_outputFiles.push_back("meshes/" + meshFilename(i, chunk, meshStats[i].chunks));
+        }
+        meshStats[i].file = "meshes/" + meshFilename(i, 0, meshStats[i].chunks);
+        meshesTimer.addBytes(meshStats[i].bytesWritten);
+      }
+      m_stats.meshes.push_back(meshStats[i]);
+
+      auto writeShape = [&](const aiMatrix4x4 &transform) {
+        for (uint32_t chunk = 0; chunk < encoded.size(); chunk++) {
+          if (serializedWriter) {
+            xml.open("shape").attribute("type", "serialized");
+            xml.property("string", "filename", serializedSceneFileName);
+            xml.property("integer", "shape_index", std::to_string(shapeIndices[chunk]));
+          } else {
+            xml.open("shape").attribute("type", "ply");
+            xml.property("string", "filename",
+                         "meshes/" + meshFilename(i, chunk, meshStats[i].chunks));
+          }
+          if (!transform.IsIdentity()) {
+            toXML(xml, transform);
+          }
+          xml.open("ref").attribute("id", materialId).close();
+          xml.close();
+        }
+      };
+
+      if (instances[i].size() == 1) {
+        writeShape(instances[i].front());
+      } else {
+        // geometry used several times is stored once in a shapegroup
+        std::string groupId = "shapegroup" + std::to_string(i);
+        xml.open("shapegroup").attribute("id", groupId);
+        writeShape(aiMatrix4x4());
+        xml.close();
+        for (const auto &transform : instances[i]) {
+          xml.open("shape").attribute("type", "instance");
+          xml.open("ref").attribute("id", groupId).close();
+          if (!transform.IsIdentity()) {
+            toXML(xml, transform);
+          }
+          xml.close();
+        }
+      }
     } catch(std::exception& e) {
       std::cout << "Warning: " << e.what() << std::endl;
     }
+    bytesInFlight -= meshBytes[i];
+  }
+
+  if (serializedWriter) {
+    serializedWriter->close();
+    meshesTimer.addBytes(fs::file_size(m_outputDirectory / serializedSceneFileName));
+  }
+  meshesTimer.stop();
 
+  PhaseTimer textureWaitTimer(m_stats, "texture transfers");
+  for (auto &transfer : textureTransfers) {
+    textureWaitTimer.addBytes(transfer.get());
   }
+  textureWaitTimer.stop();
 
-  m_xmlDoc.SaveFile(m_outputSceneDescPath.string().c_str());
+  PhaseTimer sceneTimer(m_stats, "scene.xml");
+  xml.finish();
+  sceneTimer.addBytes(fs::file_size(m_outputSceneDescPath));
+  m_outputFiles.push_back("scene.xml");
 }
 
-void convert(const std::string &inputFile, const std::string &outputDirectory) {
-  Converter converter(inputFile, outputDirectory);
+void convert(const std::string &inputFile, const std::string &outputDirectory,
+             const Options &options) {
+  Assimp::Importer importer;
+  Converter converter(importer, inputFile, outputDirectory, options);
   converter.convert();
 }
 
-} // namespace Kontsuba
\ No newline at end of file
+namespace {
+
+// Resolve a batch input (directory or manifest) into a list of models and
+// the output directories they are converted into. Outputs mirror the layout
+// of the models relative to the batch root.
+std::vector<std::pair<fs::path, fs::path>>
+collectBatchInputs(const fs::path &input, const fs::path &outputDirectory) {
+  Assimp::Importer importer;
+  std::vector<std::pair<fs::path, fs::path>> models;
+
+  auto add = [&](const fs::path &model, const fs::path &root) {
+    auto relative = model.lexically_relative(root);
+    if (relative.empty() || *relative.begin() == "..") {
+      relative = model.filename();
+    }
+    models.emplace_back(model, outputDirectory / relative.replace_extension());
+  };
+
+  if (fs::is_directory(input)) {
+    auto outputRoot = fs::weakly_canonical(outputDirectory);
+    for (const auto &entry : fs::recursive_directory_iterator(input)) {
+      if (!entry.is_regular_file()) {
+        continue;
+      }
+      // don't pick up our own output when writing into the input tree
+      auto path = fs::weakly_canonical(entry.path());
+      auto [end, _] = std::mismatch(outputRoot.begin(), outputRoot.end(),
+                                    path.begin(), path.end());
+      if (end == outputRoot.end()) {
+        continue;
+      }
+      if (importer.IsExtensionSupported(entry.path().extension().string())) {
+        add(entry.path(), input);
+      }
+    }
+    // directory iteration order is unspecified
+    std::sort(models.begin(), models.end());
+  } else {
+    // manifest with one model per line, relative to the manifest
+    std::ifstream manifest(input);
+    if (manifest.fail()) {
+      throw std::runtime_error("failed to open " + input.string());
+    }
+    std::string line;
+    while (std::getline(manifest, line)) {
+      line.erase(line.find_last_not_of(" \t\r") + 1);
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      fs::path model = expand(line);
+      if (model.is_relative()) {
+        model = input.parent_path() / model;
+      }
+      add(model.lexically_normal(), input.parent_path());
+    }
+  }
+  return models;
+}
+
+} // namespace
+
+std::vector<BatchResult>
+convertMany(const std::vector<std::pair<std::string, std::string>> &models,
+            const Options &options,
+            const std::function<void(const BatchResult &)> &onResult) {
+  // parallelism comes from converting several models at once, every single
+  // conversion runs its mesh export and texture copies on one worker each
+  Options modelOptions = options;
+  modelOptions.jobs = 1;
+  modelOptions.textureJobs = 1;
+
+  // importers are reused across models, at most one per worker
+  std::vector<std::unique_ptr<Assimp::Importer>> importers;
+  std::mutex mutex;
+  std::vector<BatchResult> results(models.size());
+
+  // declared after everything the tasks use so it is joined first, even if
+  // onResult throws
+  ThreadPool pool(options.jobs);
+  std::vector<std::future<void>> pending;
+  for (size_t i = 0; i < models.size(); i++) {
+    pending.push_back(pool.submit([&, i] {
+      auto &result = results[i];
+      result.inputFile = models[i].first;
+      result.outputDirectory = models[i].second;
+
+      std::unique_ptr<Assimp::Importer> importer;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!importers.empty()) {
+          importer = std::move(importers.back());
+          importers.pop_back();
+        }
+      }
+      if (!importer) {
+        importer = std::make_unique<Assimp::Importer>();
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      try {
+        fs::create_directories(expand(result.outputDirectory));
+        Converter converter(*importer, result.inputFile, result.outputDirectory,
+                            modelOptions);
+        converter.convert();
+        result.success = true;
+      } catch (std::exception &e) {
+        result.error = e.what();
+      }
+      importer->FreeScene();
+      result.seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+      std::lock_guard<std::mutex> lock(mutex);
+      importers.push_back(std::move(importer));
+      if (onResult) {
+        onResult(result);
+      }
+    }));
+  }
+  for (auto &future : pending) {
+    future.get();
+  }
+  return results;
+}
+
+std::vector<BatchResult>
+convertBatch(const std::string &input, const std::string &outputDirectory,
+             const Options &options,
+             const std::function<void(const BatchResult &)> &onResult) {
+  std::vector<std::pair<std::string, std::string>> models;
+  for (const auto &[model, output] :
+       collectBatchInputs(expand(input), expand(outputDirectory))) {
+    models.emplace_back(model.string(), output.string());
+  }
+  return convertMany(models, options, onResult);
+}
+
+} // namespace Kontsuba
@@ -0,0 +1,78 @@
+#include "files.h"
+
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace Kontsuba {
+namespace fs = std::filesystem;
+
+namespace {
+
+// share the extents of `from` with a new file `to` (btrfs, XFS, ...)
+bool reflink(const fs::path &from, const fs::path &to) {
+#if defined(__linux__) && defined(FICLONE)
+  int source = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (source < 0) {
+    return false;
+  }
+  int target = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (target < 0) {
+    ::close(source);
+    return false;
+  }
+  bool cloned = ::ioctl(target, FICLONE, source) == 0;
+  ::close(source);
+  ::close(target);
+  if (!cloned) {
+    std::error_code error;
+    fs::remove(to, error);
+  }
+  return cloned;
+#else
+  (void)from;
+  (void)to;
+  return false;
+#endif
+}
+
+} // namespace
+
+uint64_t transferFile(const fs::path &from, const fs::path &to, LinkMode mode) {
+  // never write through an existing link into its target
+  std::error_code error;
+  fs::remove(to, error);
+
+  switch (mode) {
+  case LinkMode::Hardlink:
+    fs::create_hard_link(from, to, error);
+    if (!error) {
+      return 0;
+    }
+    break;
+  case LinkMode::Symlink:
+    fs::create_symlink(fs::absolute(from), to, error);
+    if (!error) {
+      return 0;
+    }
+    break;
+  case LinkMode::Reflink:
+    if (reflink(from, to)) {
+      return 0;
+    }
+    break;
+  case LinkMode::Copy:
+    break;
+  }
+
+  fs::copy_file(from, to);
+  return fs::file_size(to);
+}
+
+} // namespace Kontsuba
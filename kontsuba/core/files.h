@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#include "converter.h"
+
+namespace Kontsuba {
+
+// Places the contents of `from` at `to` using `mode`, replacing whatever is at
+// `to`. Links that cannot be created (other file system, no reflink support)
+// fall back to a copy. Returns the number of bytes copied, 0 for links.
+uint64_t transferFile(const std::filesystem::path &from,
+                      const std::filesystem::path &to, LinkMode mode);
+
+} // namespace Kontsuba
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace Kontsuba {
+
+// Fast non-cryptographic 64 bit hash for fingerprinting file contents and
+// conversion parameters. Consumes input eight bytes at a time.
+class Hasher {
+public:
+  Hasher &update(const void *data, size_t size) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    m_length += size;
+
+    // top up a partially filled word from a previous update
+    while (m_pendingSize != 0 && size != 0) {
+      m_pending |= uint64_t(*bytes++) << (8 * m_pendingSize);
+      size--;
+      if (++m_pendingSize == 8) {
+        mix(m_pending);
+        m_pending = 0;
+        m_pendingSize = 0;
+      }
+    }
+    for (; size >= 8; size -= 8, bytes += 8) {
+      uint64_t word;
+      std::memcpy(&word, bytes, 8);
+      mix(word);
+    }
+    for (; size != 0; size--) {
+      m_pending |= uint64_t(*bytes++) << (8 * m_pendingSize++);
+    }
+    return *this;
+  }
+
+  Hasher &update(const std::string &value) {
+    // include the length so that consecutive strings can't alias
+    update(static_cast<uint64_t>(value.size()));
+    return update(value.data(), value.size());
+  }
+
+  template <typename T,
+            typename = std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>>
+  Hasher &update(T value) {
+    return update(&value, sizeof(T));
+  }
+
+  uint64_t digest() const {
+    uint64_t h = m_state;
+    if (m_pendingSize != 0) {
+      h = step(h, m_pending);
+    }
+    h = step(h, m_length);
+    // murmur3 finalizer
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  std::string hexdigest() const { return fmt::format("{:016x}", digest()); }
+
+private:
+  static uint64_t step(uint64_t h, uint64_t word) {
+    word *= 0x87c37b91114253d5ULL;
+    word = (word << 31) | (word >> 33);
+    word *= 0x4cf5ad432745937fULL;
+    h ^= word;
+    h = (h << 27) | (h >> 37);
+    return h * 5 + 0x52dce729;
+  }
+
+  void mix(uint64_t word) { m_state = step(m_state, word); }
+
+  uint64_t m_state = 0x9e3779b97f4a7c15ULL;
+  uint64_t m_length = 0;
+  uint64_t m_pending = 0;
+  unsigned int m_pendingSize = 0;
+};
+
+inline Hasher &hashFile(Hasher &hasher, const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (file.fail()) {
+    throw std::runtime_error("failed to open " + path.string());
+  }
+  std::vector<char> buffer(1 << 20);
+  while (file) {
+    file.read(buffer.data(), buffer.size());
+    hasher.update(buffer.data(), static_cast<size_t>(file.gcount()));
+  }
+  return hasher;
+}
+
+inline std::string hashFile(const std::filesystem::path &path) {
+  Hasher hasher;
+  return hashFile(hasher, path).hexdigest();
+}
+
+} // namespace Kontsuba
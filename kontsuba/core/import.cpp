@@ -0,0 +1,152 @@
+#include "import.h"
+
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <assimp/postprocess.h>
+#include <fmt/core.h>
+
+#include "obj_loader.h"
+
+namespace Kontsuba {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool isObjFile(const std::filesystem::path &file) {
+  std::string extension = file.extension().string();
+  for (char &c : extension) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return extension == ".obj";
+}
+
+struct PostProcessStep {
+  unsigned int flag;
+  const char *name;
+};
+
+// the enabled post-processing steps, in the order of Assimp's
+// PostStepRegistry that ReadFile runs them in. FlipUVs comes first and also
+// flips the materials' UV transforms, which TransformUVCoords then bakes in.
+std::vector<PostProcessStep> postProcessSteps(const Options &options) {
+  const PostProcessing &pp = options.postProcessing;
+  std::vector<PostProcessStep> steps;
+  auto add = [&](bool enabled, unsigned int flag, const char *name) {
+    if (enabled) {
+      steps.push_back({flag, name});
+    }
+  };
+  add(pp.flipUVs, aiProcess_FlipUVs, "FlipUVs");
+  add(pp.findDegenerates, aiProcess_FindDegenerates, "FindDegenerates");
+  add(pp.transformUVCoords, aiProcess_TransformUVCoords, "TransformUVCoords");
+  // bake the node graph into the meshes
+  add(!options.instancing, aiProcess_PreTransformVertices, "PreTransformVertices");
+  add(true, aiProcess_Triangulate, "Triangulate");
+  add(true, aiProcess_SortByPType, "SortByPType");
+  add(pp.fixInfacingNormals, aiProcess_FixInfacingNormals, "FixInfacingNormals");
+  add(pp.joinIdenticalVertices, aiProcess_JoinIdenticalVertices, "JoinIdenticalVertices");
+  return steps;
+}
+
+const aiScene *readFile(Assimp::Importer &importer,
+                        const std::filesystem::path &inputFile,
+                        const Options &options) {
+  auto steps = postProcessSteps(options);
+  if (!options.timePostProcessing) {
+    unsigned int flags = 0;
+    for (const auto &step : steps) {
+      flags |= step.flag;
+    }
+    return importer.ReadFile(inputFile.string(), flags);
+  }
+
+  // running the steps separately in registry order gives the same result as
+  // passing all flags to ReadFile
+  std::string report = fmt::format("Post-processing {}\n", inputFile.string());
+  auto start = Clock::now();
+  const aiScene *scene = importer.ReadFile(inputFile.string(), 0);
+  report += fmt::format("  {:<24}{:.3f}s\n", "Import", since(start));
+  for (const auto &step : steps) {
+    if (!scene) {
+      break;
+    }
+    start = Clock::now();
+    scene = importer.ApplyPostProcessing(step.flag);
+    report += fmt::format("  {:<24}{:.3f}s\n", step.name, since(start));
+  }
+  // a single write keeps reports of concurrent batch conversions apart
+  std::cout << report << std::flush;
+  return scene;
+}
+
+} // namespace
+
+const aiScene *importScene(Assimp::Importer &importer,
+                           const std::filesystem::path &inputFile,
+                           const Options &options,
+                           std::unique_ptr<aiScene> &ownedScene) {
+  if (options.fastObj && isObjFile(inputFile)) {
+    auto start = Clock::now();
+    try {
+      ownedScene = loadObj(*importer.GetIOHandler(), inputFile, options);
+      if (options.timePostProcessing) {
+        std::cout << fmt::format("Post-processing {}\n  {:<24}{:.3f}s\n", inputFile.string(),
+                                 "OBJ loader", since(start))
+                  << std::flush;
+      }
+      return ownedScene.get();
+    } catch (std::exception &e) {
+      std::cout << fmt::format("Warning: reading {} with Assimp: {}\n", inputFile.string(),
+                               e.what())
+                << std::flush;
+    }
+  }
+
+  const aiScene *scene = readFile(importer, inputFile, options);
+  if (!scene) {
+    throw std::runtime_error(importer.GetErrorString());
+  }
+  return scene;
+}
+
+std::vector<std::vector<aiMatrix4x4>> meshInstances(const aiScene *scene,
+                                                    const Options &options) {
+  std::vector<std::vector<aiMatrix4x4>> instances(scene->mNumMeshes);
+  if (!options.instancing) {
+    for (auto &transforms : instances) {
+      transforms.emplace_back();
+    }
+    return instances;
+  }
+  if (scene->mRootNode == nullptr) {
+    return instances;
+  }
+
+  std::vector<std::pair<const aiNode *, aiMatrix4x4>> stack{
+      {scene->mRootNode, scene->mRootNode->mTransformation}};
+  while (!stack.empty()) {
+    auto [node, transform] = stack.back();
+    stack.pop_back();
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+      instances[node->mMeshes[i]].push_back(transform);
+    }
+    // push in reverse to visit children in order
+    for (unsigned int i = node->mNumChildren; i-- > 0;) {
+      const aiNode *child = node->mChildren[i];
+      stack.emplace_back(child, transform * child->mTransformation);
+    }
+  }
+  return instances;
+}
+
+} // namespace Kontsuba
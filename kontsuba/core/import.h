@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "converter.h"
+
+namespace Kontsuba {
+
+// Reads `inputFile` with the post-processing steps selected by `options`.
+// .obj files are read by loadObj() if enabled, which hands the scene over in
+// `ownedScene`; otherwise it is owned by `importer`. Files are opened through
+// the importer's IOSystem either way. Throws with Assimp's error message if
+// the file cannot be imported.
+const aiScene *importScene(Assimp::Importer &importer,
+                           const std::filesystem::path &inputFile,
+                           const Options &options,
+                           std::unique_ptr<aiScene> &ownedScene);
+
+// World transforms of every placement of each mesh. Without instancing the
+// node graph is baked into the meshes and each one is placed exactly once.
+std::vector<std::vector<aiMatrix4x4>> meshInstances(const aiScene *scene,
+                                                    const Options &options);
+
+} // namespace Kontsuba
@@ -1,9 +1,142 @@
 #pragma once
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace Kontsuba {
 
-void convert(const std::string &inputFile, const std::string &outputDirectory);
+enum class MeshFormat {
+  Ply,        // one binary .ply file per mesh
+  Serialized  // all meshes in a single zlib compressed Mitsuba .serialized file
+};
 
-}
\ No newline at end of file
+// How files that are used unchanged, like textures, are placed in the output
+enum class LinkMode {
+  Copy,
+  Hardlink,  // shares the source file, the output must be treated as read-only
+  Symlink,   // absolute link to the source file
+  Reflink    // copy-on-write clone where the file system supports it
+};
+
+enum class TextureFormat {
+  Original,  // textures are used as they are
+  Exr,       // uncompressed half float OpenEXR
+  Rgbe       // Radiance RGBE (.hdr), drops alpha
+};
+
+// Optional Assimp post-processing steps. Triangulation and splitting meshes by
+// primitive type always run since the mesh writers only handle triangles.
+struct PostProcessing {
+  // merge vertices with identical attributes, expensive on large meshes
+  bool joinIdenticalVertices = true;
+  // turn degenerate triangles into lines and points, which are then dropped
+  bool findDegenerates = true;
+  // flip normals that point into closed meshes
+  bool fixInfacingNormals = true;
+  // convert to Mitsuba's texture coordinate origin
+  bool flipUVs = true;
+  // bake UV transforms of the source materials into the texture coordinates
+  bool transformUVCoords = true;
+
+  // skips the expensive cleanup steps, for inputs that are known to be clean
+  static PostProcessing fast() {
+    PostProcessing steps;
+    steps.joinIdenticalVertices = false;
+    steps.findDegenerates = false;
+    steps.fixInfacingNormals = false;
+    return steps;
+  }
+};
+
+struct Options {
+  MeshFormat meshFormat = MeshFormat::Ply;
+  // number of worker threads used for mesh export, 0 uses all cores
+  unsigned int jobs = 0;
+  // number of textures copied concurrently alongside the mesh export, 0 uses
+  // one worker per core
+  unsigned int textureJobs = 4;
+  // approximate bytes the mesh export may work on at once; further meshes
+  // wait until earlier ones are written. 0 is unlimited. Meshes are released
+  // as soon as they are written either way. The imported scene is not
+  // covered: it stays resident until its meshes are written.
+  uint64_t memoryBudget = 0;
+  // read the input through memory maps instead of buffered stdio
+  bool memoryMapInput = true;
+  // read .obj files with the built-in parallel loader instead of Assimp,
+  // files it cannot handle still go through Assimp
+  bool fastObj = true;
+  // keep the node graph: meshes are written once and placed via to_world
+  // transforms, meshes used several times become shapegroup instances
+  bool instancing = false;
+  PostProcessing postProcessing;
+  // apply the post-processing steps one at a time and print how long the
+  // import and each step took
+  bool timePostProcessing = false;
+  // drop faces that duplicate an earlier face of the same mesh
+  bool removeDuplicateFaces = false;
+  // concatenate the meshes of each material that are placed once without a
+  // transform into shapes of at most mergeMaxVertices vertices
+  bool mergeMeshes = false;
+  uint32_t mergeMaxVertices = 1 << 20;
+  // split meshes with more faces into spatially coherent shapes of at most
+  // this many faces that Mitsuba can load in parallel, 0 disables
+  uint32_t maxFacesPerShape = 0;
+  // reorder faces for vertex cache locality and vertices in the order they
+  // are first used, which speeds up rasterized previews and BVH builds
+  bool optimizeMeshOrder = false;
+  // textures with identical contents are always written once, this selects
+  // how they are placed; links fall back to copies where unsupported
+  LinkMode textureLinks = LinkMode::Copy;
+  // transcode textures into a format Mitsuba loads without decompressing;
+  // textures that cannot be decoded are used as they are
+  TextureFormat textureFormat = TextureFormat::Original;
+  // halve transcoded textures until neither side exceeds this, 0 keeps the
+  // original resolution
+  unsigned int textureMaxResolution = 0;
+  // print wall time, bytes written and resident memory per phase, and time
+  // and bytes written per mesh
+  bool printStats = false;
+  // write the same statistics to stats.json next to scene.xml
+  bool writeStatsJson = false;
+  // reuse previous results stored in this directory if the input file, the
+  // files it references and the options are unchanged; empty disables caching
+  std::string cacheDirectory;
+  // hardlink cached files instead of copying them, the linked outputs must
+  // then be treated as read-only
+  bool cacheHardlinks = false;
+};
+
+// Converts a single model. Conversions share no state, so several may run
+// concurrently on different threads.
+void convert(const std::string &inputFile, const std::string &outputDirectory,
+             const Options &options = Options());
+
+struct BatchResult {
+  std::string inputFile;
+  std::string outputDirectory;
+  bool success = false;
+  std::string error;
+  double seconds = 0.0;
+};
+
+// Converts each (input file, output directory) pair concurrently on
+// `options.jobs` workers. Failures are reported per model instead of thrown;
+// `onResult` is called (serialized) as soon as a model is done.
+std::vector<BatchResult>
+convertMany(const std::vector<std::pair<std::string, std::string>> &models,
+            const Options &options = Options(),
+            const std::function<void(const BatchResult &)> &onResult = {});
+
+// Converts every model found in `input` into its own subdirectory of
+// `outputDirectory` using convertMany(). `input` is either a directory, which
+// is searched recursively for files Assimp can import, or a manifest listing
+// one model per line.
+std::vector<BatchResult>
+convertBatch(const std::string &input, const std::string &outputDirectory,
+             const Options &options = Options(),
+             const std::function<void(const BatchResult &)> &onResult = {});
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "converter.h"
+
+struct aiMesh;
+struct aiScene;
+
+namespace Assimp {
+class Importer;
+}
+
+namespace Kontsuba {
+
+// One element of the scene description, mirrors an element of scene.xml
+struct Element {
+  std::string name;
+  std::vector<std::pair<std::string, std::string>> attributes;
+  std::vector<Element> children;
+
+  // value of attribute `key`, nullptr if missing
+  const std::string *attribute(const std::string &key) const;
+};
+
+// Mesh data as imported; the pointers reference memory owned by the Scene
+struct MeshView {
+  std::string name;
+  // id of the bsdf element the mesh refers to
+  std::string material;
+  uint32_t vertexCount = 0;
+  // three floats per vertex
+  const float *positions = nullptr;
+  // three floats per vertex, nullptr if the mesh has no normals
+  const float *normals = nullptr;
+  // three floats per vertex of which the first two are u and v, nullptr if
+  // the mesh has no texture coordinates
+  const float *texcoords = nullptr;
+  // three vertex indices per face
+  std::vector<uint32_t> indices;
+  // row-major to_world matrix of every placement of the mesh
+  std::vector<std::array<float, 16>> transforms;
+};
+
+// A converted scene kept in memory instead of being written to disk
+class Scene {
+public:
+  ~Scene();
+
+  Scene(const Scene &) = delete;
+  Scene &operator=(const Scene &) = delete;
+
+  // integrator, emitters, sensor and bsdfs in the order of scene.xml
+  const std::vector<Element> &elements() const { return m_elements; }
+  const std::vector<MeshView> &meshes() const { return m_meshes; }
+
+private:
+  Scene();
+
+  friend std::shared_ptr<Scene> loadScene(const std::string &, const Options &);
+
+  std::unique_ptr<Assimp::Importer> m_importer;
+  // the scene if it was not read by the importer
+  std::unique_ptr<aiScene> m_ownedScene;
+  // meshes concatenated with Options::mergeMeshes
+  std::vector<std::unique_ptr<aiMesh>> m_mergedMeshes;
+  // embedded textures written for the bitmaps, empty if there are none
+  std::filesystem::path m_textureDirectory;
+  std::vector<Element> m_elements;
+  std::vector<MeshView> m_meshes;
+};
+
+// Imports `inputFile` with the same processing as convert() but keeps the
+// result in memory. Textures reference the source files by absolute path,
+// embedded textures are written to a temporary directory that exists as long
+// as the Scene, and vertex data is not copied. Options that only concern the
+// written files (mesh format, splitting and reordering, jobs, caching,
+// statistics) are ignored.
+std::shared_ptr<Scene> loadScene(const std::string &inputFile,
+                                 const Options &options = Options());
+
+} // namespace Kontsuba
@@ -0,0 +1,84 @@
+#include "io_system.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KONTSUBA_HAS_MMAP
+#endif
+
+namespace Kontsuba {
+
+MappedIOStream::~MappedIOStream() {
+#ifdef KONTSUBA_HAS_MMAP
+  if (m_size != 0) {
+    munmap(m_data, m_size);
+  }
+#endif
+}
+
+size_t MappedIOStream::Read(void *pvBuffer, size_t pSize, size_t pCount) {
+  if (pSize == 0) {
+    return 0;
+  }
+  // like fread, only whole elements are read
+  size_t count = std::min(pCount, (m_size - m_position) / pSize);
+  std::memcpy(pvBuffer, data() + m_position, count * pSize);
+  m_position += count * pSize;
+  return count;
+}
+
+aiReturn MappedIOStream::Seek(size_t pOffset, aiOrigin pOrigin) {
+  size_t base = pOrigin == aiOrigin_CUR ? m_position : pOrigin == aiOrigin_END ? m_size : 0;
+  if (base + pOffset > m_size) {
+    return aiReturn_FAILURE;
+  }
+  m_position = base + pOffset;
+  return aiReturn_SUCCESS;
+}
+
+Assimp::IOStream *MappedIOSystem::Open(const char *pFile, const char *pMode) {
+#ifdef KONTSUBA_HAS_MMAP
+  if (std::strpbrk(pMode, "wa+") == nullptr) {
+    int fd = ::open(pFile, O_RDONLY);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat status {};
+    void *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode)) {
+      size = static_cast<size_t>(status.st_size);
+      if (size == 0) {
+        mapped = true;
+      } else {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        mapped = data != MAP_FAILED;
+      }
+    }
+    // the mapping stays valid after closing the descriptor
+    ::close(fd);
+    if (mapped) {
+      if (size != 0) {
+        madvise(data, size, MADV_SEQUENTIAL);
+      }
+      return new MappedIOStream(data, size);
+    }
+  }
+#endif
+  return DefaultIOSystem::Open(pFile, pMode);
+}
+
+std::unique_ptr<Assimp::IOSystem> inputIOSystem(const Options &options) {
+  if (options.memoryMapInput) {
+    return std::make_unique<MappedIOSystem>();
+  }
+  return std::make_unique<Assimp::DefaultIOSystem>();
+}
+
+} // namespace Kontsuba
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOSystem.hpp>
+#include <assimp/Importer.hpp>
+
+#include "converter.h"
+
+namespace Kontsuba {
+
+// Read-only stream over a memory mapped file
+class MappedIOStream : public Assimp::IOStream {
+public:
+  // takes ownership of the mapping of `size` bytes at `data`
+  MappedIOStream(void *data, size_t size) : m_data(data), m_size(size) {}
+  ~MappedIOStream() override;
+
+  size_t Read(void *pvBuffer, size_t pSize, size_t pCount) override;
+  size_t Write(const void *, size_t, size_t) override { return 0; }
+  aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override;
+  size_t Tell() const override { return m_position; }
+  size_t FileSize() const override { return m_size; }
+  void Flush() override {}
+
+  // the whole file, for readers that parse it in place
+  const char *data() const { return static_cast<const char *>(m_data); }
+
+private:
+  void *m_data;
+  size_t m_size;
+  size_t m_position = 0;
+};
+
+// Reads files through read-only memory maps that the kernel is told are
+// accessed sequentially, instead of through buffered stdio. Files that are
+// opened for writing or cannot be mapped are handled by DefaultIOSystem.
+class MappedIOSystem : public Assimp::DefaultIOSystem {
+public:
+  Assimp::IOStream *Open(const char *pFile, const char *pMode = "rb") override;
+};
+
+// the IOSystem input files are read with according to `options`
+std::unique_ptr<Assimp::IOSystem> inputIOSystem(const Options &options);
+
+// Installs an IOSystem on an importer and switches back to a default one
+// when going out of scope. The importer owns the installed system and
+// deletes it when it is replaced by another non-null handler;
+// SetIOHandler(nullptr) would leave it allocated.
+class ScopedIOHandler {
+public:
+  ScopedIOHandler(Assimp::Importer &importer, Assimp::IOSystem *system)
+      : m_importer(importer) {
+    m_importer.SetIOHandler(system);
+  }
+  ~ScopedIOHandler() { m_importer.SetIOHandler(new Assimp::DefaultIOSystem); }
+
+  ScopedIOHandler(const ScopedIOHandler &) = delete;
+  ScopedIOHandler &operator=(const ScopedIOHandler &) = delete;
+
+private:
+  Assimp::Importer &m_importer;
+};
+
+// Forwards all file access of an importer to another IOSystem and remembers
+// every file that was opened, i.e. the input file itself plus anything it
+// references (.mtl libraries, external buffers, ...).
+class RecordingIOSystem : public Assimp::IOSystem {
+public:
+  explicit RecordingIOSystem(
+      std::unique_ptr<Assimp::IOSystem> inner = std::make_unique<Assimp::DefaultIOSystem>())
+      : m_inner(std::move(inner)) {}
+
+  bool Exists(const char *pFile) const override { return m_inner->Exists(pFile); }
+
+  char getOsSeparator() const override { return m_inner->getOsSeparator(); }
+
+  Assimp::IOStream *Open(const char *pFile, const char *pMode = "rb") override {
+    auto stream = m_inner->Open(pFile, pMode);
+    if (stream != nullptr) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_opened.insert(pFile);
+    }
+    return stream;
+  }
+
+  void Close(Assimp::IOStream *pFile) override { m_inner->Close(pFile); }
+
+  bool ComparePaths(const char *one, const char *second) const override {
+    return m_inner->ComparePaths(one, second);
+  }
+
+  std::set<std::string> openedFiles() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_opened;
+  }
+
+private:
+  std::unique_ptr<Assimp::IOSystem> m_inner;
+  mutable std::mutex m_mutex;
+  std::set<std::string> m_opened;
+};
+
+} // namespace Kontsuba
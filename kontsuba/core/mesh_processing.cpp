@@ -0,0 +1,469 @@
+#include "mesh_processing.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace Kontsuba {
+
+namespace {
+
+using VertexKey = std::array<int64_t, 3>;
+using FaceKey = std::array<VertexKey, 3>;
+
+uint64_t mix(uint64_t h, uint64_t value) {
+  // splitmix64 finalizer applied to the combined state
+  h ^= value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+} // namespace
+
+std::vector<uint32_t> triangleIndices(const aiMesh *mesh) {
+  std::vector<uint32_t> indices;
+  indices.reserve(3 * static_cast<size_t>(mesh->mNumFaces));
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    const aiFace &face = mesh->mFaces[i];
+    auto numIndices = face.mNumIndices;
+    if (numIndices != 3) {
+      throw std::runtime_error("only triangles are supported. Number of Vertices: " +
+        std::to_string(numIndices) + " in Mesh: " + mesh->mName.C_Str());
+    }
+    indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+  }
+  return indices;
+}
+
+void removeDuplicateFaces(const aiMesh *mesh, std::vector<uint32_t> &indices,
+                          float epsilon) {
+  const size_t numFaces = indices.size() / 3;
+  if (numFaces < 2) {
+    return;
+  }
+
+  // snap every vertex once
+  std::vector<VertexKey> vertexKeys(mesh->mNumVertices);
+  const double scale = 1.0 / epsilon;
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    const aiVector3D &v = mesh->mVertices[i];
+    vertexKeys[i] = {std::llround(v.x * scale), std::llround(v.y * scale),
+                     std::llround(v.z * scale)};
+  }
+
+  // sorting the corners makes the key independent of winding and rotation
+  auto faceKey = [&](size_t face) {
+    FaceKey key = {vertexKeys[indices[3 * face]], vertexKeys[indices[3 * face + 1]],
+                   vertexKeys[indices[3 * face + 2]]};
+    if (key[1] < key[0]) std::swap(key[0], key[1]);
+    if (key[2] < key[1]) std::swap(key[1], key[2]);
+    if (key[1] < key[0]) std::swap(key[0], key[1]);
+    return key;
+  };
+
+  auto hash = [](const FaceKey &key) {
+    uint64_t h = 0;
+    for (const auto &vertex : key) {
+      for (auto coordinate : vertex) {
+        h = mix(h, static_cast<uint64_t>(coordinate));
+      }
+    }
+    return h;
+  };
+
+  // open addressing with linear probing, kept at most half full
+  struct Slot {
+    uint64_t hash;
+    uint32_t face;
+  };
+  constexpr uint32_t empty = std::numeric_limits<uint32_t>::max();
+  size_t capacity = 1;
+  while (capacity < 2 * numFaces) {
+    capacity <<= 1;
+  }
+  std::vector<Slot> table(capacity, Slot{0, empty});
+  const size_t mask = capacity - 1;
+
+  size_t kept = 0;
+  for (size_t face = 0; face < numFaces; face++) {
+    auto key = faceKey(face);
+    auto h = hash(key);
+    bool duplicate = false;
+    for (size_t slot = h & mask;; slot = (slot + 1) & mask) {
+      if (table[slot].face == empty) {
+        table[slot] = {h, static_cast<uint32_t>(kept)};
+        break;
+      }
+      if (table[slot].hash == h && faceKey(table[slot].face) == key) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (!duplicate) {
+      // compact in place, kept faces never overtake the current one
+      std::copy_n(&indices[3 * face], 3, &indices[3 * kept]);
+      kept++;
+    }
+  }
+  indices.resize(3 * kept);
+}
+
+std::vector<std::vector<uint32_t>> partitionFaces(const aiMesh *mesh,
+                                                  const std::vector<uint32_t> &indices,
+                                                  uint32_t maxFaces) {
+  size_t faceCount = indices.size() / 3;
+  std::vector<aiVector3D> centroids(faceCount);
+  for (size_t f = 0; f < faceCount; f++) {
+    centroids[f] = (mesh->mVertices[indices[3 * f]] + mesh->mVertices[indices[3 * f + 1]] +
+                    mesh->mVertices[indices[3 * f + 2]]) *
+                   (1.0f / 3.0f);
+  }
+  std::vector<uint32_t> faces(faceCount);
+  for (size_t f = 0; f < faceCount; f++) {
+    faces[f] = static_cast<uint32_t>(f);
+  }
+
+  // ranges of `faces` still to split, processed depth first so chunks that
+  // are close in space are also close in the output
+  std::vector<std::vector<uint32_t>> chunks;
+  std::vector<std::pair<size_t, size_t>> pending{{0, faceCount}};
+  while (!pending.empty()) {
+    auto [begin, end] = pending.back();
+    pending.pop_back();
+    if (end - begin <= std::max<uint32_t>(maxFaces, 1)) {
+      std::vector<uint32_t> chunk;
+      chunk.reserve(3 * (end - begin));
+      // keep the original face order within the chunk
+      std::sort(faces.begin() + begin, faces.begin() + end);
+      for (size_t i = begin; i < end; i++) {
+        chunk.insert(chunk.end(), indices.begin() + 3 * faces[i],
+                     indices.begin() + 3 * faces[i] + 3);
+      }
+      chunks.push_back(std::move(chunk));
+      continue;
+    }
+
+    constexpr float kMax = std::numeric_limits<float>::max();
+    aiVector3D lower(kMax, kMax, kMax);
+    aiVector3D upper(-kMax, -kMax, -kMax);
+    for (size_t i = begin; i < end; i++) {
+      const aiVector3D &c = centroids[faces[i]];
+      for (int axis = 0; axis < 3; axis++) {
+        lower[axis] = std::min(lower[axis], c[axis]);
+        upper[axis] = std::max(upper[axis], c[axis]);
+      }
+    }
+    aiVector3D extent = upper - lower;
+    unsigned int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    size_t middle = begin + (end - begin) / 2;
+    std::nth_element(faces.begin() + begin, faces.begin() + middle, faces.begin() + end,
+                     [&](uint32_t a, uint32_t b) {
+                       return centroids[a][axis] < centroids[b][axis];
+                     });
+    pending.emplace_back(middle, end);
+    pending.emplace_back(begin, middle);
+  }
+  return chunks;
+}
+
+namespace {
+
+// copy of the vertices `used` of `mesh`, in that order, without faces
+std::unique_ptr<aiMesh> copyVertices(const aiMesh *mesh, const std::vector<uint32_t> &used) {
+  auto copy = std::make_unique<aiMesh>();
+  copy->mName = mesh->mName;
+  copy->mMaterialIndex = mesh->mMaterialIndex;
+  copy->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+  copy->mNumVertices = static_cast<unsigned int>(used.size());
+  copy->mVertices = new aiVector3D[used.size()];
+  if (mesh->HasNormals()) {
+    copy->mNormals = new aiVector3D[used.size()];
+  }
+  if (mesh->HasTextureCoords(0)) {
+    copy->mTextureCoords[0] = new aiVector3D[used.size()];
+    copy->mNumUVComponents[0] = mesh->mNumUVComponents[0];
+  }
+  for (size_t i = 0; i < used.size(); i++) {
+    copy->mVertices[i] = mesh->mVertices[used[i]];
+    if (copy->mNormals) {
+      copy->mNormals[i] = mesh->mNormals[used[i]];
+    }
+    if (copy->mTextureCoords[0]) {
+      copy->mTextureCoords[0][i] = mesh->mTextureCoords[0][used[i]];
+    }
+  }
+  return copy;
+}
+
+std::unique_ptr<aiMesh> concatenate(const std::vector<const aiMesh *> &parts,
+                                    const std::string &name) {
+  auto merged = std::make_unique<aiMesh>();
+  const aiMesh *first = parts.front();
+  merged->mName.Set(name);
+  merged->mMaterialIndex = first->mMaterialIndex;
+  merged->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+  for (const aiMesh *part : parts) {
+    merged->mNumVertices += part->mNumVertices;
+    merged->mNumFaces += part->mNumFaces;
+  }
+  merged->mVertices = new aiVector3D[merged->mNumVertices];
+  if (first->HasNormals()) {
+    merged->mNormals = new aiVector3D[merged->mNumVertices];
+  }
+  if (first->HasTextureCoords(0)) {
+    merged->mTextureCoords[0] = new aiVector3D[merged->mNumVertices];
+    merged->mNumUVComponents[0] = first->mNumUVComponents[0];
+  }
+  merged->mFaces = new aiFace[merged->mNumFaces];
+
+  unsigned int vertexOffset = 0, faceOffset = 0;
+  for (const aiMesh *part : parts) {
+    std::copy_n(part->mVertices, part->mNumVertices, merged->mVertices + vertexOffset);
+    if (merged->mNormals) {
+      std::copy_n(part->mNormals, part->mNumVertices, merged->mNormals + vertexOffset);
+    }
+    if (merged->mTextureCoords[0]) {
+      std::copy_n(part->mTextureCoords[0], part->mNumVertices,
+                  merged->mTextureCoords[0] + vertexOffset);
+    }
+    for (unsigned int i = 0; i < part->mNumFaces; i++) {
+      aiFace &face = merged->mFaces[faceOffset + i];
+      face.mNumIndices = 3;
+      face.mIndices = new unsigned int[3];
+      for (int corner = 0; corner < 3; corner++) {
+        face.mIndices[corner] = part->mFaces[i].mIndices[corner] + vertexOffset;
+      }
+    }
+    vertexOffset += part->mNumVertices;
+    faceOffset += part->mNumFaces;
+  }
+  return merged;
+}
+
+constexpr uint32_t kUnused = std::numeric_limits<uint32_t>::max();
+
+} // namespace
+
+std::unique_ptr<aiMesh> extractChunk(const aiMesh *mesh,
+                                     const std::vector<uint32_t> &indices,
+                                     std::vector<uint32_t> &localIndices) {
+  // vertices keep their relative order
+  std::vector<uint32_t> localIndex(mesh->mNumVertices, kUnused);
+  for (uint32_t index : indices) {
+    localIndex[index] = 0;
+  }
+  std::vector<uint32_t> used;
+  for (uint32_t i = 0; i < mesh->mNumVertices; i++) {
+    if (localIndex[i] != kUnused) {
+      localIndex[i] = static_cast<uint32_t>(used.size());
+      used.push_back(i);
+    }
+  }
+
+  localIndices.resize(indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    localIndices[i] = localIndex[indices[i]];
+  }
+  return copyVertices(mesh, used);
+}
+
+uint64_t cacheMisses(const std::vector<uint32_t> &indices, uint32_t vertexCount) {
+  // a vertex is cached if it entered the FIFO less than its size misses ago
+  std::vector<uint64_t> enteredAt(vertexCount, 0);
+  uint64_t misses = 0;
+  for (uint32_t index : indices) {
+    if (enteredAt[index] == 0 || misses + 1 - enteredAt[index] > kVertexCacheSize) {
+      misses++;
+      enteredAt[index] = misses;
+    }
+  }
+  return misses;
+}
+
+void optimizeFaceOrder(std::vector<uint32_t> &indices, uint32_t vertexCount) {
+  const size_t faceCount = indices.size() / 3;
+  if (faceCount == 0) {
+    return;
+  }
+
+  // faces around each vertex
+  std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+  for (uint32_t index : indices) {
+    adjacencyStart[index + 1]++;
+  }
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    adjacencyStart[v + 1] += adjacencyStart[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> filled(adjacencyStart.begin(), adjacencyStart.end() - 1);
+  for (size_t i = 0; i < indices.size(); i++) {
+    adjacency[filled[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  // faces not yet emitted around each vertex
+  std::vector<uint32_t> live(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    live[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+  }
+  std::vector<uint64_t> cachedAt(vertexCount, 0);
+  std::vector<bool> emitted(faceCount, false);
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  uint64_t time = kVertexCacheSize + 1;
+  uint32_t cursor = 0;
+
+  uint32_t fan = indices[0];
+  while (fan != kUnused) {
+    // emit all remaining faces around the fanning vertex
+    candidates.clear();
+    for (uint32_t k = adjacencyStart[fan]; k < adjacencyStart[fan + 1]; k++) {
+      uint32_t face = adjacency[k];
+      if (emitted[face]) {
+        continue;
+      }
+      emitted[face] = true;
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t v = indices[3 * face + corner];
+        result.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cachedAt[v] > kVertexCacheSize) {
+          cachedAt[v] = time++;
+        }
+      }
+    }
+
+    // continue with the candidate that stays in the cache longest while its
+    // remaining faces are emitted
+    fan = kUnused;
+    uint64_t bestPriority = 0;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0) {
+        continue;
+      }
+      uint64_t age = time - cachedAt[v];
+      uint64_t priority = age + 2 * live[v] <= kVertexCacheSize ? age + 1 : 1;
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = v;
+      }
+    }
+    if (fan != kUnused) {
+      continue;
+    }
+    // dead end: fall back to recently used vertices, then to any vertex with
+    // faces left
+    while (!deadEnds.empty() && fan == kUnused) {
+      uint32_t v = deadEnds.back();
+      deadEnds.pop_back();
+      if (live[v] > 0) {
+        fan = v;
+      }
+    }
+    while (cursor < vertexCount && fan == kUnused) {
+      if (live[cursor] > 0) {
+        fan = cursor;
+      }
+      cursor++;
+    }
+  }
+  indices = std::move(result);
+}
+
+std::unique_ptr<aiMesh> optimizeVertexOrder(const aiMesh *mesh,
+                                            std::vector<uint32_t> &indices) {
+  std::vector<uint32_t> newIndex(mesh->mNumVertices, kUnused);
+  std::vector<uint32_t> used;
+  for (uint32_t &index : indices) {
+    if (newIndex[index] == kUnused) {
+      newIndex[index] = static_cast<uint32_t>(used.size());
+      used.push_back(index);
+    }
+    index = newIndex[index];
+  }
+  return copyVertices(mesh, used);
+}
+
+std::vector<std::unique_ptr<aiMesh>>
+mergeMeshes(std::vector<const aiMesh *> &meshes,
+            std::vector<std::vector<aiMatrix4x4>> &instances,
+            const std::vector<std::string> &materialIds, uint32_t maxVertices) {
+  // groups in order of their first mesh, each key has one open group
+  using Key = std::tuple<std::string, bool, bool>;
+  std::vector<std::vector<size_t>> groups;
+  std::vector<uint64_t> groupVertices;
+  std::map<Key, size_t> openGroup;
+  for (size_t i = 0; i < meshes.size(); i++) {
+    const aiMesh *mesh = meshes[i];
+    if (instances[i].size() != 1 || !instances[i][0].IsIdentity() ||
+        mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE ||
+        mesh->mNumVertices > maxVertices) {
+      continue;
+    }
+    Key key{materialIds.at(mesh->mMaterialIndex), mesh->HasNormals(),
+            mesh->HasTextureCoords(0)};
+    auto open = openGroup.find(key);
+    if (open == openGroup.end() ||
+        groupVertices[open->second] + mesh->mNumVertices > maxVertices) {
+      open = openGroup.insert_or_assign(key, groups.size()).first;
+      groups.emplace_back();
+      groupVertices.push_back(0);
+    }
+    groups[open->second].push_back(i);
+    groupVertices[open->second] += mesh->mNumVertices;
+  }
+
+  std::vector<std::unique_ptr<aiMesh>> merged;
+  for (const auto &group : groups) {
+    if (group.size() < 2) {
+      continue;
+    }
+    std::vector<const aiMesh *> parts;
+    for (size_t i : group) {
+      parts.push_back(meshes[i]);
+    }
+    merged.push_back(concatenate(parts, materialIds.at(parts.front()->mMaterialIndex)));
+    meshes[group.front()] = merged.back().get();
+    for (size_t k = 1; k < group.size(); k++) {
+      instances[group[k]].clear();
+    }
+  }
+  return merged;
+}
+
+void releaseMeshData(aiMesh *mesh) {
+  delete[] mesh->mVertices;
+  mesh->mVertices = nullptr;
+  delete[] mesh->mNormals;
+  mesh->mNormals = nullptr;
+  delete[] mesh->mTangents;
+  mesh->mTangents = nullptr;
+  delete[] mesh->mBitangents;
+  mesh->mBitangents = nullptr;
+  for (auto &texcoords : mesh->mTextureCoords) {
+    delete[] texcoords;
+    texcoords = nullptr;
+  }
+  for (auto &colors : mesh->mColors) {
+    delete[] colors;
+    colors = nullptr;
+  }
+  delete[] mesh->mFaces;
+  mesh->mFaces = nullptr;
+  mesh->mNumVertices = 0;
+  mesh->mNumFaces = 0;
+}
+
+} // namespace Kontsuba
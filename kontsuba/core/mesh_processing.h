@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <assimp/scene.h>
+
+namespace Kontsuba {
+
+// Flattened vertex indices of a triangle mesh, three per face. Throws if the
+// mesh contains anything but triangles.
+std::vector<uint32_t> triangleIndices(const aiMesh *mesh);
+
+// Remove faces that cover the same triangle as an earlier face, regardless of
+// vertex order or orientation. Positions are snapped to a grid with spacing
+// `epsilon` before comparing, so hashing and equality agree exactly. The
+// order of the remaining faces is preserved.
+void removeDuplicateFaces(const aiMesh *mesh, std::vector<uint32_t> &indices,
+                          float epsilon = 1e-4f);
+
+// Partitions the faces in `indices` into spatially coherent chunks of at
+// most `maxFaces` faces by recursively splitting at the median face
+// centroid along the longest axis. Returns the indices of each chunk.
+std::vector<std::vector<uint32_t>> partitionFaces(const aiMesh *mesh,
+                                                  const std::vector<uint32_t> &indices,
+                                                  uint32_t maxFaces);
+
+// Copy of the vertices of `mesh` that `indices` refers to. The faces of the
+// returned mesh are left empty, its indices are stored in `localIndices`.
+std::unique_ptr<aiMesh> extractChunk(const aiMesh *mesh,
+                                     const std::vector<uint32_t> &indices,
+                                     std::vector<uint32_t> &localIndices);
+
+// Size of the FIFO vertex cache that optimizeFaceOrder() targets and
+// cacheMisses() simulates
+constexpr uint32_t kVertexCacheSize = 16;
+
+// Number of vertex cache misses when drawing `indices` in order; divided by
+// the number of faces this is the average cache miss ratio (ACMR)
+uint64_t cacheMisses(const std::vector<uint32_t> &indices, uint32_t vertexCount);
+
+// Reorders the faces in `indices` for vertex cache locality with the
+// Tipsify algorithm (Sander et al. 2007), which runs in linear time
+void optimizeFaceOrder(std::vector<uint32_t> &indices, uint32_t vertexCount);
+
+// Copy of `mesh` with the vertices in the order of their first use in
+// `indices`, which is remapped accordingly. Unused vertices are dropped.
+std::unique_ptr<aiMesh> optimizeVertexOrder(const aiMesh *mesh,
+                                            std::vector<uint32_t> &indices);
+
+// Concatenates triangle meshes that are placed exactly once without a
+// transform and share a material id (`materialIds`, by material index) and
+// vertex layout. Merged meshes hold at most `maxVertices` vertices. Each
+// merged mesh replaces the first mesh of its group in `meshes`, the
+// placements of the other members are cleared. Returns the merged meshes,
+// which must outlive `meshes`.
+std::vector<std::unique_ptr<aiMesh>>
+mergeMeshes(std::vector<const aiMesh *> &meshes,
+            std::vector<std::vector<aiMatrix4x4>> &instances,
+            const std::vector<std::string> &materialIds, uint32_t maxVertices);
+
+// Frees the vertex and face arrays of a mesh that is no longer needed; its
+// name and material index are kept
+void releaseMeshData(aiMesh *mesh);
+
+} // namespace Kontsuba
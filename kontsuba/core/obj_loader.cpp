@@ -0,0 +1,935 @@
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <assimp/material.h>
+#include <fmt/core.h>
+
+#include "io_system.h"
+#include "thread_pool.h"
+
+namespace Kontsuba {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// smaller files are parsed by a single task
+constexpr size_t kMinChunkBytes = 1 << 20;
+// chunks per worker, evens out chunks that hold more faces than others
+constexpr size_t kChunksPerWorker = 4;
+
+// Face corners hold 0-based indices into the whole file, or kMissing for an
+// absent texture coordinate or normal. Relative (negative) indices depend on
+// the vertices of earlier chunks and are stored as the index into their own
+// chunk minus kRelative until the chunk offsets are known.
+constexpr int64_t kMissing = -1;
+constexpr int64_t kRelative = int64_t(1) << 62;
+
+struct Corner {
+  int64_t position;
+  int64_t texcoord;
+  int64_t normal;
+};
+
+// mtllib and usemtl statements, which are resolved in file order
+struct Statement {
+  bool library;
+  // faces of the chunk before the statement
+  size_t face;
+  std::string name;
+  // index of the used material, set once the libraries are loaded
+  uint32_t material = 0;
+};
+
+struct Chunk {
+  std::vector<aiVector3D> positions;
+  std::vector<aiVector3D> texcoords;
+  std::vector<aiVector3D> normals;
+  std::vector<Corner> corners;
+  // end of the corners of each face
+  std::vector<size_t> faceEnds;
+  std::vector<Statement> statements;
+};
+
+// A file opened through an IOSystem, parsed in place when it is memory mapped
+class FileContents {
+public:
+  FileContents(Assimp::IOSystem &io, const std::string &path)
+      : m_io(io), m_stream(io.Open(path.c_str(), "rb")) {
+    if (m_stream == nullptr) {
+      return;
+    }
+    if (auto mapped = dynamic_cast<MappedIOStream *>(m_stream)) {
+      m_data = mapped->data();
+      m_size = mapped->FileSize();
+    } else {
+      m_buffer.resize(m_stream->FileSize());
+      m_size = m_stream->Read(m_buffer.data(), 1, m_buffer.size());
+      m_data = m_buffer.data();
+    }
+  }
+
+  ~FileContents() {
+    if (m_stream != nullptr) {
+      m_io.Close(m_stream);
+    }
+  }
+
+  FileContents(const FileContents &) = delete;
+  FileContents &operator=(const FileContents &) = delete;
+
+  bool opened() const { return m_stream != nullptr; }
+  const char *begin() const { return m_data; }
+  const char *end() const { return m_data + m_size; }
+  size_t size() const { return m_size; }
+
+private:
+  Assimp::IOSystem &m_io;
+  Assimp::IOStream *m_stream;
+  std::vector<char> m_buffer;
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+};
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+const char *skipSpaces(const char *p, const char *end) {
+  while (p < end && isSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+// the rest of the line without surrounding whitespace
+std::string restOfLine(const char *p, const char *end) {
+  p = skipSpaces(p, end);
+  while (end > p && isSpace(end[-1])) {
+    end--;
+  }
+  return std::string(p, end);
+}
+
+double powerOfTen(int exponent) {
+  static constexpr double kExact[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                      1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                      1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  return exponent <= 22 ? kExact[exponent] : std::pow(10.0, exponent);
+}
+
+// Parses a decimal number after optional spaces. Unlike strtof this ignores
+// the locale and does not need a terminated string. Returns the position after
+// the number or nullptr if there is none.
+const char *parseFloat(const char *p, const char *end, float &value) {
+  // more digits than fit are only counted in the exponent
+  constexpr uint64_t kMaxMantissa = 100000000000000000ull;
+  p = skipSpaces(p, end);
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  for (; p < end && isDigit(*p); p++, digits = true) {
+    if (mantissa < kMaxMantissa) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && isDigit(*p); p++, digits = true) {
+      if (mantissa < kMaxMantissa) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (!digits) {
+    return nullptr;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negativeExponent = q < end && *q == '-';
+    if (q < end && (*q == '-' || *q == '+')) {
+      q++;
+    }
+    int e = 0;
+    if (q < end && isDigit(*q)) {
+      for (; q < end && isDigit(*q); q++) {
+        e = std::min(e * 10 + (*q - '0'), 10000);
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+  if (p < end && !isSpace(*p)) {
+    return nullptr;
+  }
+  double result = static_cast<double>(mantissa);
+  result = exponent < 0 ? result / powerOfTen(-exponent) : result * powerOfTen(exponent);
+  value = static_cast<float>(negative ? -result : result);
+  return p;
+}
+
+// parses up to three numbers of which the first `required` must be present
+const char *parseVector(const char *p, const char *end, aiVector3D &v, int required) {
+  float *components[] = {&v.x, &v.y, &v.z};
+  for (int i = 0; i < 3; i++) {
+    const char *next = parseFloat(p, end, *components[i]);
+    if (next == nullptr) {
+      return i < required ? nullptr : p;
+    }
+    p = next;
+  }
+  return p;
+}
+
+// Parses one index of a face corner into the encoding described at
+// kRelative; `count` is the number of elements read so far in the chunk
+const char *parseIndex(const char *p, const char *end, size_t count, int64_t &index) {
+  bool negative = p < end && *p == '-';
+  if (negative) {
+    p++;
+  }
+  if (p == end || !isDigit(*p)) {
+    return nullptr;
+  }
+  int64_t value = 0;
+  for (; p < end && isDigit(*p); p++) {
+    // out of range either way, saturating keeps the encoding from overflowing
+    value = value < kRelative / 10 ? value * 10 + (*p - '0') : kRelative;
+  }
+  if (value == 0) {
+    return nullptr;
+  }
+  index = negative ? static_cast<int64_t>(count) - value - kRelative : value - 1;
+  return p;
+}
+
+void parseFace(const char *p, const char *end, Chunk &chunk) {
+  auto fail = [] { throw std::runtime_error("malformed face"); };
+  while ((p = skipSpaces(p, end)) < end) {
+    Corner corner{kMissing, kMissing, kMissing};
+    p = parseIndex(p, end, chunk.positions.size(), corner.position);
+    if (p == nullptr) {
+      fail();
+    }
+    if (p < end && *p == '/') {
+      p++;
+      if (p < end && *p != '/' && !isSpace(*p)) {
+        p = parseIndex(p, end, chunk.texcoords.size(), corner.texcoord);
+        if (p == nullptr) {
+          fail();
+        }
+      }
+      if (p < end && *p == '/') {
+        p = parseIndex(p + 1, end, chunk.normals.size(), corner.normal);
+        if (p == nullptr) {
+          fail();
+        }
+      }
+    }
+    if (p < end && !isSpace(*p)) {
+      fail();
+    }
+    chunk.corners.push_back(corner);
+  }
+  chunk.faceEnds.push_back(chunk.corners.size());
+}
+
+void parseLine(const char *p, const char *end, Chunk &chunk) {
+  p = skipSpaces(p, end);
+  if (p == end || *p == '#') {
+    return;
+  }
+  const char *keywordEnd = p;
+  while (keywordEnd < end && !isSpace(*keywordEnd)) {
+    keywordEnd++;
+  }
+  std::string_view keyword(p, keywordEnd - p);
+  p = keywordEnd;
+
+  if (end[-1] == '\\') {
+    throw std::runtime_error("line continuations are not supported");
+  }
+  if (keyword == "v" || keyword == "vn" || keyword == "vt") {
+    aiVector3D v(0.0f, 0.0f, 0.0f);
+    // texture coordinates may omit v and w, colors after positions are ignored
+    if (parseVector(p, end, v, keyword == "vt" ? 1 : 3) == nullptr) {
+      throw std::runtime_error(fmt::format("malformed {} statement", keyword));
+    }
+    auto &target = keyword == "v" ? chunk.positions
+                   : keyword == "vn" ? chunk.normals
+                                     : chunk.texcoords;
+    target.push_back(v);
+  } else if (keyword == "f") {
+    parseFace(p, end, chunk);
+  } else if (keyword == "usemtl" || keyword == "mtllib") {
+    chunk.statements.push_back(
+        {keyword == "mtllib", chunk.faceEnds.size(), restOfLine(p, end)});
+  }
+  // lines and points are dropped like Assimp's output of them, groups,
+  // objects and smoothing groups do not change the result
+}
+
+void parseChunk(const char *p, const char *end, Chunk &chunk) {
+  while (p < end) {
+    const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+    const char *contentEnd = lineEnd;
+    while (contentEnd > p && isSpace(contentEnd[-1])) {
+      contentEnd--;
+    }
+    if (contentEnd > p) {
+      parseLine(p, contentEnd, chunk);
+    }
+    p = lineEnd + 1;
+  }
+}
+
+// Material as described by an MTL file, with the defaults of Assimp's OBJ
+// importer
+struct MaterialDesc {
+  std::string name;
+  aiColor3D ambient{0.0f, 0.0f, 0.0f};
+  aiColor3D diffuse{0.6f, 0.6f, 0.6f};
+  aiColor3D specular{0.0f, 0.0f, 0.0f};
+  aiColor3D emissive{0.0f, 0.0f, 0.0f};
+  float shininess = 0.0f;
+  float opacity = 1.0f;
+  float ior = 1.0f;
+  std::optional<float> roughness;
+  std::optional<float> metallic;
+  std::optional<aiColor3D> sheen;
+  std::optional<float> clearcoat;
+  std::optional<float> clearcoatRoughness;
+  std::optional<float> anisotropy;
+  std::map<aiTextureType, std::string> textures;
+};
+
+// sets the properties Assimp's OBJ importer sets, under the same keys
+aiMaterial *toMaterial(const MaterialDesc &desc) {
+  auto material = new aiMaterial();
+  aiString name(desc.name);
+  material->AddProperty(&name, AI_MATKEY_NAME);
+  material->AddProperty(&desc.ambient, 1, AI_MATKEY_COLOR_AMBIENT);
+  material->AddProperty(&desc.diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+  material->AddProperty(&desc.specular, 1, AI_MATKEY_COLOR_SPECULAR);
+  material->AddProperty(&desc.emissive, 1, AI_MATKEY_COLOR_EMISSIVE);
+  material->AddProperty(&desc.shininess, 1, AI_MATKEY_SHININESS);
+  material->AddProperty(&desc.opacity, 1, AI_MATKEY_OPACITY);
+  material->AddProperty(&desc.ior, 1, AI_MATKEY_REFRACTI);
+  auto addOptional = [&](const auto &value, const char *key, unsigned int type,
+                         unsigned int index) {
+    if (value) {
+      material->AddProperty(&*value, 1, key, type, index);
+    }
+  };
+  addOptional(desc.roughness, AI_MATKEY_ROUGHNESS_FACTOR);
+  addOptional(desc.metallic, AI_MATKEY_METALLIC_FACTOR);
+  addOptional(desc.sheen, AI_MATKEY_SHEEN_COLOR_FACTOR);
+  addOptional(desc.clearcoat, AI_MATKEY_CLEARCOAT_FACTOR);
+  addOptional(desc.clearcoatRoughness, AI_MATKEY_CLEARCOAT_ROUGHNESS_FACTOR);
+  addOptional(desc.anisotropy, AI_MATKEY_ANISOTROPY_FACTOR);
+  for (const auto &[type, file] : desc.textures) {
+    aiString path(file);
+    material->AddProperty(&path, AI_MATKEY_TEXTURE(type, 0));
+  }
+  return material;
+}
+
+// Materials in the order Assimp's OBJ importer lists them: its default
+// material, then those of the libraries, then unknown names used by usemtl
+class MaterialLibrary {
+public:
+  MaterialLibrary() { add("DefaultMaterial"); }
+
+  // index of material `name`, which is created with defaults if unknown
+  uint32_t add(const std::string &name) {
+    auto [known, added] = m_indexOf.emplace(name, static_cast<uint32_t>(m_materials.size()));
+    if (added) {
+      m_materials.emplace_back();
+      m_materials.back().name = name;
+    }
+    return known->second;
+  }
+
+  void load(Assimp::IOSystem &io, const fs::path &file);
+
+  const std::vector<MaterialDesc> &materials() const { return m_materials; }
+
+private:
+  std::vector<MaterialDesc> m_materials;
+  std::unordered_map<std::string, uint32_t> m_indexOf;
+};
+
+// texture statements by their lowercase keyword; like Assimp's MTL parser
+// the loader matches keywords regardless of case (map_Kd, map_kd, MAP_KD)
+const std::map<std::string_view, aiTextureType> &textureKeywords() {
+  static const std::map<std::string_view, aiTextureType> keywords = {
+      {"map_kd", aiTextureType_DIFFUSE},
+      {"map_ka", aiTextureType_AMBIENT},
+      {"map_ks", aiTextureType_SPECULAR},
+      {"map_d", aiTextureType_OPACITY},
+      {"map_ke", aiTextureType_EMISSIVE},
+      {"map_emissive", aiTextureType_EMISSIVE},
+      {"map_ns", aiTextureType_SHININESS},
+      {"bump", aiTextureType_HEIGHT},
+      {"map_bump", aiTextureType_HEIGHT},
+      {"norm", aiTextureType_NORMALS},
+      {"map_kn", aiTextureType_NORMALS},
+      {"disp", aiTextureType_DISPLACEMENT},
+      {"refl", aiTextureType_REFLECTION},
+      {"map_pr", aiTextureType_DIFFUSE_ROUGHNESS},
+      {"map_pm", aiTextureType_METALNESS},
+  };
+  return keywords;
+}
+
+// statements that don't affect the converted materials, which Assimp's
+// importer doesn't turn into anything the converter reads either
+bool isIgnoredKeyword(std::string_view keyword) {
+  return keyword == "illum" || keyword == "tf" || keyword == "sharpness" ||
+         keyword == "map_aat" || keyword == "decal";
+}
+
+// file name of a texture statement, after its options
+std::string textureFile(const char *p, const char *end) {
+  // arguments of each option, -o, -s and -t take up to three
+  static const std::map<std::string_view, int> kArguments = {
+      {"-blendu", 1}, {"-blendv", 1}, {"-boost", 1}, {"-bm", 1},   {"-cc", 1},
+      {"-clamp", 1},  {"-imfchan", 1}, {"-texres", 1}, {"-type", 1}, {"-mm", 2},
+      {"-o", 3},      {"-s", 3},      {"-t", 3}};
+  auto nextToken = [&](const char *from) {
+    from = skipSpaces(from, end);
+    const char *to = from;
+    while (to < end && !isSpace(*to)) {
+      to++;
+    }
+    return std::string_view(from, to - from);
+  };
+  while (true) {
+    std::string_view option = nextToken(p);
+    auto it = kArguments.find(option);
+    if (it == kArguments.end()) {
+      return restOfLine(p, end);
+    }
+    p = option.data() + option.size();
+    bool numeric = it->second == 3 || option == "-mm";
+    for (int i = 0; i < it->second; i++) {
+      std::string_view argument = nextToken(p);
+      float ignored;
+      if (numeric && i > 0 && parseFloat(argument.data(), end, ignored) == nullptr) {
+        break;
+      }
+      p = argument.data() + argument.size();
+    }
+  }
+}
+
+void MaterialLibrary::load(Assimp::IOSystem &io, const fs::path &file) {
+  // missing libraries leave the materials at their defaults, as in Assimp
+  FileContents contents(io, file.string());
+  if (!contents.opened()) {
+    return;
+  }
+  MaterialDesc *current = nullptr;
+  std::set<std::string> unsupported;
+  const char *p = contents.begin(), *end = contents.end();
+  while (p < end) {
+    const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+    const char *line = skipSpaces(p, lineEnd);
+    const char *keywordEnd = line;
+    while (keywordEnd < lineEnd && !isSpace(*keywordEnd)) {
+      keywordEnd++;
+    }
+    std::string keyword(line, keywordEnd - line);
+    for (char &c : keyword) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    const char *args = keywordEnd;
+    p = lineEnd + 1;
+
+    if (keyword == "newmtl") {
+      current = &m_materials[add(restOfLine(args, lineEnd))];
+      continue;
+    }
+    if (current == nullptr || keyword.empty() || keyword[0] == '#') {
+      continue;
+    }
+    float value;
+    auto number = [&](auto &target) {
+      if (parseFloat(args, lineEnd, value) != nullptr) {
+        target = value;
+      }
+    };
+    // a single value sets all channels
+    auto color = [&](auto &target) {
+      aiColor3D c;
+      const char *next = parseFloat(args, lineEnd, c.r);
+      if (next == nullptr) {
+        return;
+      }
+      if ((next = parseFloat(next, lineEnd, c.g)) == nullptr ||
+          parseFloat(next, lineEnd, c.b) == nullptr) {
+        c.g = c.b = c.r;
+      }
+      target = c;
+    };
+    if (keyword == "kd") {
+      color(current->diffuse);
+    } else if (keyword == "ka") {
+      color(current->ambient);
+    } else if (keyword == "ks") {
+      color(current->specular);
+    } else if (keyword == "ke") {
+      color(current->emissive);
+    } else if (keyword == "ns") {
+      number(current->shininess);
+    } else if (keyword == "ni") {
+      number(current->ior);
+    } else if (keyword == "d") {
+      number(current->opacity);
+    } else if (keyword == "tr") {
+      if (parseFloat(args, lineEnd, value) != nullptr) {
+        current->opacity = 1.0f - value;
+      }
+    } else if (keyword == "pr") {
+      number(current->roughness);
+    } else if (keyword == "pm") {
+      number(current->metallic);
+    } else if (keyword == "ps") {
+      color(current->sheen);
+    } else if (keyword == "pc") {
+      number(current->clearcoat);
+    } else if (keyword == "pcr") {
+      number(current->clearcoatRoughness);
+    } else if (keyword == "aniso") {
+      number(current->anisotropy);
+    } else if (auto it = textureKeywords().find(keyword); it != textureKeywords().end()) {
+      std::string texture = textureFile(args, lineEnd);
+      if (!texture.empty()) {
+        current->textures[it->second] = texture;
+      }
+    } else if (!isIgnoredKeyword(keyword)) {
+      unsupported.emplace(line, keywordEnd - line);
+    }
+  }
+
+  if (!unsupported.empty()) {
+    std::string list;
+    for (const auto &keyword : unsupported) {
+      list += (list.empty() ? "" : ", ") + keyword;
+    }
+    std::cout << fmt::format("Warning: {}: ignoring unsupported statements {}\n",
+                             file.string(), list)
+              << std::flush;
+  }
+}
+
+struct VertexKeyHash {
+  size_t operator()(const std::array<int64_t, 3> &key) const {
+    uint64_t h = static_cast<uint64_t>(key[0]) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint64_t>(key[1]) + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key[2]) + 0x94D049BB133111EBull + (h << 6) + (h >> 2);
+    return static_cast<size_t>(h);
+  }
+};
+
+// the position, texture coordinate and normal a vertex is written with
+using VertexData = std::array<float, 9>;
+
+struct VertexDataHash {
+  size_t operator()(const VertexData &data) const {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (float value : data) {
+      uint32_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      h = (h ^ bits) * 0x100000001B3ull;
+    }
+    return static_cast<size_t>(h);
+  }
+};
+
+// Corner of a quad at which Assimp's Triangulate starts its fan: the concave
+// corner, whose angles to the diagonal add up to more than pi, or else 0
+size_t fanStart(const std::array<aiVector3D, 4> &p) {
+  for (size_t i = 0; i < 4; i++) {
+    aiVector3D left = p[(i + 3) % 4] - p[i];
+    aiVector3D diagonal = p[(i + 2) % 4] - p[i];
+    aiVector3D right = p[(i + 1) % 4] - p[i];
+    left.Normalize();
+    diagonal.Normalize();
+    right.Normalize();
+    if (std::acos(left * diagonal) + std::acos(right * diagonal) > AI_MATH_PI_F) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+// Assimp's FixInfacingNormals heuristic: normals point inwards if moving the
+// vertices along them shrinks the bounding box, unless the mesh is planar
+bool normalsPointInwards(const aiVector3D *positions, const aiVector3D *normals,
+                         size_t count) {
+  aiVector3D min0(1e10f, 1e10f, 1e10f), max0(-1e10f, -1e10f, -1e10f);
+  aiVector3D min1 = min0, max1 = max0;
+  auto extend = [](aiVector3D &min, aiVector3D &max, const aiVector3D &v) {
+    min.x = std::min(min.x, v.x), max.x = std::max(max.x, v.x);
+    min.y = std::min(min.y, v.y), max.y = std::max(max.y, v.y);
+    min.z = std::min(min.z, v.z), max.z = std::max(max.z, v.z);
+  };
+  for (size_t i = 0; i < count; i++) {
+    extend(min1, max1, positions[i]);
+    extend(min0, max0, positions[i] + normals[i]);
+  }
+  aiVector3D delta0 = max0 - min0, delta1 = max1 - min1;
+  if ((delta0.x > 0.0f) != (delta1.x > 0.0f) || (delta0.y > 0.0f) != (delta1.y > 0.0f) ||
+      (delta0.z > 0.0f) != (delta1.z > 0.0f)) {
+    return false;
+  }
+  if (delta1.x < 0.05f * std::sqrt(delta1.y * delta1.z) ||
+      delta1.y < 0.05f * std::sqrt(delta1.z * delta1.x) ||
+      delta1.z < 0.05f * std::sqrt(delta1.y * delta1.x)) {
+    return false;
+  }
+  return std::fabs(delta0.x * delta0.y * delta0.z) < std::fabs(delta1.x * delta1.y * delta1.z);
+}
+
+// The vertex data of the whole file, gathered from the chunks
+struct Vertices {
+  std::vector<aiVector3D> positions;
+  std::vector<aiVector3D> texcoords;
+  std::vector<aiVector3D> normals;
+};
+
+// Builds the triangle mesh of the faces that use `material`. `faces` holds the
+// indices of those faces in each chunk and `offsets` the number of positions,
+// texture coordinates and normals before each chunk. Returns nullptr if no
+// face is left.
+std::unique_ptr<aiMesh> buildMesh(const std::vector<Chunk> &chunks,
+                                  const std::vector<std::vector<uint32_t>> &faces,
+                                  const std::vector<std::array<int64_t, 3>> &offsets,
+                                  const Vertices &vertices, uint32_t material,
+                                  const std::string &name, const Options &options) {
+  const int64_t counts[] = {static_cast<int64_t>(vertices.positions.size()),
+                            static_cast<int64_t>(vertices.texcoords.size()),
+                            static_cast<int64_t>(vertices.normals.size())};
+  auto resolve = [&](int64_t index, size_t chunk, int element) {
+    if (index == kMissing) {
+      return index;
+    }
+    if (index < 0) {
+      index += kRelative + offsets[chunk][element];
+    }
+    if (index < 0 || index >= counts[element]) {
+      throw std::runtime_error("face index out of range");
+    }
+    return index;
+  };
+
+  // the (v, vt, vn) indices of each vertex, its data is only copied into
+  // the mesh once the number of vertices is known
+  std::vector<std::array<int64_t, 3>> keys;
+  bool hasTexcoords = false, hasNormals = false;
+  std::vector<uint32_t> indices;
+  // Like JoinIdenticalVertices, vertices are joined by their data if the step
+  // is enabled; equal indices are looked up first since they are the common
+  // case. Otherwise every corner is a vertex of its own, as Assimp imports it.
+  const bool join = options.postProcessing.joinIdenticalVertices;
+  std::unordered_map<std::array<int64_t, 3>, uint32_t, VertexKeyHash> vertexOf;
+  std::unordered_map<VertexData, uint32_t, VertexDataHash> vertexOfData;
+  auto dataOf = [&](const std::array<int64_t, 3> &key) {
+    const aiVector3D zero(0.0f, 0.0f, 0.0f);
+    const aiVector3D &p = vertices.positions[key[0]];
+    const aiVector3D &t = key[1] != kMissing ? vertices.texcoords[key[1]] : zero;
+    const aiVector3D &n = key[2] != kMissing ? vertices.normals[key[2]] : zero;
+    // adding zero turns -0 into 0, which compares equal
+    return VertexData{p.x + 0.0f, p.y + 0.0f, p.z + 0.0f, t.x + 0.0f, t.y + 0.0f,
+                      t.z + 0.0f, n.x + 0.0f, n.y + 0.0f, n.z + 0.0f};
+  };
+  auto addVertex = [&](const std::array<int64_t, 3> &key) {
+    keys.push_back(key);
+    return static_cast<uint32_t>(keys.size() - 1);
+  };
+  std::vector<std::array<int64_t, 3>> polygon;
+  std::vector<uint32_t> polygonVertices;
+  for (size_t c = 0; c < chunks.size(); c++) {
+    const Chunk &chunk = chunks[c];
+    for (uint32_t face : faces[c]) {
+      polygon.clear();
+      for (size_t i = face ? chunk.faceEnds[face - 1] : 0; i < chunk.faceEnds[face]; i++) {
+        const Corner &corner = chunk.corners[i];
+        std::array<int64_t, 3> key = {resolve(corner.position, c, 0),
+                                      resolve(corner.texcoord, c, 1),
+                                      resolve(corner.normal, c, 2)};
+        // FindDegenerates drops corners at the position of an earlier one,
+        // faces with less than three corners left are dropped with lines
+        // and points
+        bool duplicate = options.postProcessing.findDegenerates &&
+                         std::any_of(polygon.begin(), polygon.end(), [&](const auto &other) {
+                           return vertices.positions[other[0]] == vertices.positions[key[0]];
+                         });
+        if (!duplicate) {
+          polygon.push_back(key);
+        }
+      }
+      if (polygon.size() < 3) {
+        continue;
+      }
+      // Triangulate ear-clips larger polygons, which is not reproduced here
+      if (polygon.size() > 4) {
+        throw std::runtime_error("faces with more than four corners are not supported");
+      }
+      polygonVertices.clear();
+      for (const auto &key : polygon) {
+        // a corner joined with one that lacks them still brings its data
+        hasTexcoords |= key[1] != kMissing;
+        hasNormals |= key[2] != kMissing;
+        if (!join) {
+          polygonVertices.push_back(addVertex(key));
+          continue;
+        }
+        auto [known, added] = vertexOf.emplace(key, 0);
+        if (added) {
+          auto [same, addedData] = vertexOfData.emplace(dataOf(key), 0);
+          if (addedData) {
+            same->second = addVertex(key);
+          }
+          known->second = same->second;
+        }
+        polygonVertices.push_back(known->second);
+      }
+      if (polygonVertices.size() == 3) {
+        indices.insert(indices.end(), polygonVertices.begin(), polygonVertices.end());
+        continue;
+      }
+      // quads are split into two triangles as Triangulate does
+      size_t start = fanStart({vertices.positions[polygon[0][0]],
+                               vertices.positions[polygon[1][0]],
+                               vertices.positions[polygon[2][0]],
+                               vertices.positions[polygon[3][0]]});
+      auto corner = [&](size_t i) { return polygonVertices[(start + i) % 4]; };
+      indices.insert(indices.end(), {corner(0), corner(1), corner(2)});
+      indices.insert(indices.end(), {corner(0), corner(2), corner(3)});
+    }
+  }
+  if (indices.empty()) {
+    return nullptr;
+  }
+  vertexOf = {};
+  vertexOfData = {};
+
+  auto mesh = std::make_unique<aiMesh>();
+  mesh->mName.Set(name);
+  mesh->mMaterialIndex = material;
+  mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+  mesh->mNumVertices = static_cast<unsigned int>(keys.size());
+  mesh->mVertices = new aiVector3D[keys.size()];
+  if (hasNormals) {
+    mesh->mNormals = new aiVector3D[keys.size()];
+  }
+  if (hasTexcoords) {
+    mesh->mTextureCoords[0] = new aiVector3D[keys.size()];
+    mesh->mNumUVComponents[0] = 2;
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    const auto &key = keys[i];
+    mesh->mVertices[i] = vertices.positions[key[0]];
+    if (hasTexcoords) {
+      mesh->mTextureCoords[0][i] =
+          key[1] != kMissing ? vertices.texcoords[key[1]] : aiVector3D(0.0f, 0.0f, 0.0f);
+    }
+    if (hasNormals) {
+      mesh->mNormals[i] =
+          key[2] != kMissing ? vertices.normals[key[2]] : aiVector3D(0.0f, 0.0f, 0.0f);
+    }
+  }
+
+  if (hasNormals && options.postProcessing.fixInfacingNormals &&
+      normalsPointInwards(mesh->mVertices, mesh->mNormals, keys.size())) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      mesh->mNormals[i] *= -1.0f;
+    }
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      std::swap(indices[i], indices[i + 2]);
+    }
+  }
+  if (hasTexcoords && options.postProcessing.flipUVs) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      mesh->mTextureCoords[0][i].y = 1.0f - mesh->mTextureCoords[0][i].y;
+    }
+  }
+
+  mesh->mNumFaces = static_cast<unsigned int>(indices.size() / 3);
+  mesh->mFaces = new aiFace[mesh->mNumFaces];
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    aiFace &face = mesh->mFaces[i];
+    face.mNumIndices = 3;
+    face.mIndices = new unsigned int[3];
+    std::copy(&indices[3 * i], &indices[3 * i] + 3, face.mIndices);
+  }
+  return mesh;
+}
+
+// Waits for every task of a batch before their results are taken, so no task
+// still refers to the locals of loadObj when one of them rethrows
+template <typename T> void waitAll(const std::vector<std::future<T>> &futures) {
+  for (const auto &future : futures) {
+    future.wait();
+  }
+}
+
+} // namespace
+
+std::unique_ptr<aiScene> loadObj(Assimp::IOSystem &io, const fs::path &inputFile,
+                                 const Options &options) {
+  FileContents contents(io, inputFile.string());
+  if (!contents.opened()) {
+    throw std::runtime_error(fmt::format("Unable to open file \"{}\".", inputFile.string()));
+  }
+  ThreadPool pool(options.jobs);
+
+  // chunks end at line ends and are parsed concurrently
+  size_t chunkCount = std::clamp<size_t>(contents.size() / kMinChunkBytes, 1,
+                                         pool.size() * kChunksPerWorker);
+  std::vector<const char *> bounds{contents.begin()};
+  for (size_t i = 1; i < chunkCount; i++) {
+    const char *p = std::max(bounds.back(), contents.begin() + i * contents.size() / chunkCount);
+    auto lineEnd = static_cast<const char *>(std::memchr(p, '\n', contents.end() - p));
+    bounds.push_back(lineEnd ? lineEnd + 1 : contents.end());
+  }
+  bounds.push_back(contents.end());
+
+  std::vector<Chunk> chunks(chunkCount);
+  std::vector<std::future<void>> parsed;
+  for (size_t i = 0; i < chunkCount; i++) {
+    parsed.push_back(pool.submit(
+        [&chunks, &bounds, i] { parseChunk(bounds[i], bounds[i + 1], chunks[i]); }));
+  }
+  waitAll(parsed);
+  for (auto &result : parsed) {
+    result.get();
+  }
+
+  // load the libraries and resolve material names in file order
+  MaterialLibrary library;
+  uint32_t current = 0;
+  std::vector<uint32_t> materialAtStart;
+  for (auto &chunk : chunks) {
+    materialAtStart.push_back(current);
+    for (auto &statement : chunk.statements) {
+      if (statement.library) {
+        library.load(io, inputFile.parent_path() / statement.name);
+      } else {
+        current = statement.material = library.add(statement.name);
+      }
+    }
+  }
+  const auto &materials = library.materials();
+
+  // gather the vertex data of all chunks
+  Vertices vertices;
+  std::vector<std::array<int64_t, 3>> offsets;
+  for (auto &chunk : chunks) {
+    offsets.push_back({static_cast<int64_t>(vertices.positions.size()),
+                       static_cast<int64_t>(vertices.texcoords.size()),
+                       static_cast<int64_t>(vertices.normals.size())});
+    vertices.positions.insert(vertices.positions.end(), chunk.positions.begin(),
+                              chunk.positions.end());
+    vertices.texcoords.insert(vertices.texcoords.end(), chunk.texcoords.begin(),
+                              chunk.texcoords.end());
+    vertices.normals.insert(vertices.normals.end(), chunk.normals.begin(),
+                            chunk.normals.end());
+    chunk.positions = {};
+    chunk.texcoords = {};
+    chunk.normals = {};
+  }
+
+  // faces of each chunk grouped by material, as facesOf[material][chunk]
+  std::vector<std::vector<std::vector<uint32_t>>> facesOf(
+      materials.size(), std::vector<std::vector<uint32_t>>(chunkCount));
+  std::vector<std::future<void>> grouped;
+  for (size_t c = 0; c < chunkCount; c++) {
+    grouped.push_back(pool.submit([&, c] {
+      const Chunk &chunk = chunks[c];
+      uint32_t material = materialAtStart[c];
+      size_t statement = 0;
+      for (size_t face = 0; face < chunk.faceEnds.size(); face++) {
+        for (; statement < chunk.statements.size() &&
+               chunk.statements[statement].face <= face;
+             statement++) {
+          if (!chunk.statements[statement].library) {
+            material = chunk.statements[statement].material;
+          }
+        }
+        facesOf[material][c].push_back(static_cast<uint32_t>(face));
+      }
+    }));
+  }
+  waitAll(grouped);
+  for (auto &result : grouped) {
+    result.get();
+  }
+
+  // like PreTransformVertices, one mesh per material in material order
+  std::vector<std::future<std::unique_ptr<aiMesh>>> built;
+  for (uint32_t m = 0; m < materials.size(); m++) {
+    built.push_back(pool.submit([&, m] {
+      return buildMesh(chunks, facesOf[m], offsets, vertices, m, materials[m].name, options);
+    }));
+  }
+  std::vector<std::unique_ptr<aiMesh>> meshes;
+  waitAll(built);
+  for (auto &result : built) {
+    if (auto mesh = result.get()) {
+      meshes.push_back(std::move(mesh));
+    }
+  }
+  if (meshes.empty()) {
+    throw std::runtime_error("no triangles");
+  }
+
+  auto scene = std::make_unique<aiScene>();
+  scene->mNumMaterials = static_cast<unsigned int>(materials.size());
+  scene->mMaterials = new aiMaterial *[materials.size()];
+  for (size_t i = 0; i < materials.size(); i++) {
+    scene->mMaterials[i] = toMaterial(materials[i]);
+  }
+  scene->mNumMeshes = static_cast<unsigned int>(meshes.size());
+  scene->mMeshes = new aiMesh *[meshes.size()];
+  scene->mRootNode = new aiNode(inputFile.filename().string());
+  scene->mRootNode->mNumMeshes = scene->mNumMeshes;
+  scene->mRootNode->mMeshes = new unsigned int[meshes.size()];
+  for (size_t i = 0; i < meshes.size(); i++) {
+    scene->mMeshes[i] = meshes[i].release();
+    scene->mRootNode->mMeshes[i] = static_cast<unsigned int>(i);
+  }
+  return scene;
+}
+
+} // namespace Kontsuba
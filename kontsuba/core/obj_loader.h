@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+#include <assimp/IOSystem.hpp>
+#include <assimp/scene.h>
+
+#include "converter.h"
+
+namespace Kontsuba {
+
+// Reads a Wavefront OBJ file and its MTL libraries without Assimp. The result
+// matches what importScene() gets from Assimp after post-processing: one
+// triangle mesh per material below the root node, quads triangulated like
+// Triangulate does and the enabled FindDegenerates, FixInfacingNormals and
+// FlipUVs steps applied. With JoinIdenticalVertices enabled, vertices with
+// identical data are joined; unlike Assimp, vertices that only differ by a
+// tiny epsilon are kept apart. Otherwise every face corner is a vertex of its
+// own. The file is parsed in parallel on `options.jobs` workers, in place if
+// `io` memory maps it. All files are opened through `io`.
+// Throws if the file uses something the loader does not handle (faces with
+// more than four corners, line continuations, out of range indices, ...);
+// Assimp should be used instead.
+std::unique_ptr<aiScene> loadObj(Assimp::IOSystem &io,
+                                 const std::filesystem::path &inputFile,
+                                 const Options &options);
+
+} // namespace Kontsuba
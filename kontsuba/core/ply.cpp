@@ -0,0 +1,107 @@
+#include "ply.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace Kontsuba {
+
+namespace {
+
+constexpr size_t kChunkSize = 4 << 20;
+
+class ChunkedWriter {
+public:
+  ChunkedWriter(std::ofstream &stream, const std::string &filename)
+      : m_stream(stream), m_filename(filename) {
+    m_buffer.resize(kChunkSize);
+  }
+
+  // reserve `size` bytes in the staging buffer, flushing it if necessary
+  char *next(size_t size) {
+    if (m_used + size > m_buffer.size()) {
+      flush();
+    }
+    char *out = m_buffer.data() + m_used;
+    m_used += size;
+    return out;
+  }
+
+  void flush() {
+    m_stream.write(m_buffer.data(), m_used);
+    if (m_stream.fail()) {
+      throw std::runtime_error("failed to write " + m_filename);
+    }
+    m_used = 0;
+  }
+
+private:
+  std::ofstream &m_stream;
+  const std::string &m_filename;
+  std::vector<char> m_buffer;
+  size_t m_used = 0;
+};
+
+template <typename T>
+char *put(char *out, const T &value) {
+  std::memcpy(out, &value, sizeof(T));
+  return out + sizeof(T);
+}
+
+} // namespace
+
+void writePly(const std::string &filename, const aiMesh *mesh,
+              const std::vector<uint32_t> &indices) {
+  std::ofstream stream(filename, std::ios::out | std::ios::binary);
+  if (stream.fail()) {
+    throw std::runtime_error("failed to open " + filename);
+  }
+
+  const bool hasNormals = mesh->HasNormals();
+  const bool hasTexCoords = mesh->HasTextureCoords(0);
+  const size_t numFaces = indices.size() / 3;
+
+  std::string header = "ply\n"
+                       "format binary_little_endian 1.0\n"
+                       "comment generated by kontsuba\n";
+  header += "element vertex " + std::to_string(mesh->mNumVertices) + "\n";
+  header += "property float x\nproperty float y\nproperty float z\n";
+  if (hasNormals) {
+    header += "property float nx\nproperty float ny\nproperty float nz\n";
+  }
+  if (hasTexCoords) {
+    header += "property float u\nproperty float v\n";
+  }
+  header += "element face " + std::to_string(numFaces) + "\n";
+  header += "property list uchar uint vertex_indices\n";
+  header += "end_header\n";
+  stream.write(header.data(), header.size());
+
+  ChunkedWriter writer(stream, filename);
+
+  size_t vertexSize = 3 * sizeof(float);
+  vertexSize += hasNormals ? 3 * sizeof(float) : 0;
+  vertexSize += hasTexCoords ? 2 * sizeof(float) : 0;
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    char *out = writer.next(vertexSize);
+    out = put(out, mesh->mVertices[i]);
+    if (hasNormals) {
+      out = put(out, mesh->mNormals[i]);
+    }
+    if (hasTexCoords) {
+      out = put(out, mesh->mTextureCoords[0][i].x);
+      out = put(out, mesh->mTextureCoords[0][i].y);
+    }
+  }
+
+  constexpr size_t faceSize = sizeof(uint8_t) + 3 * sizeof(uint32_t);
+  for (size_t i = 0; i < numFaces; i++) {
+    char *out = writer.next(faceSize);
+    out = put(out, uint8_t(3));
+    std::memcpy(out, &indices[3 * i], 3 * sizeof(uint32_t));
+  }
+
+  writer.flush();
+}
+
+} // namespace Kontsuba
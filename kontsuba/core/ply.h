@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <assimp/mesh.h>
+
+namespace Kontsuba {
+
+// Writes a triangle mesh as binary little endian PLY.
+//
+// Vertex records (position, normal, uv) are interleaved straight from the
+// aiMesh arrays into a large staging buffer which is flushed in big chunks,
+// so the file is produced in a single pass without per-property stream
+// writes. `indices` holds three vertex indices per face.
+void writePly(const std::string &filename, const aiMesh *mesh,
+              const std::vector<uint32_t> &indices);
+
+} // namespace Kontsuba
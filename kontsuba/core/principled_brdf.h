@@ -2,18 +2,19 @@
 
 #include <optional>
 #include <filesystem>
+#include <functional>
 #include <set>
 #include <random>
 
 #include <assimp/scene.h>
 #include <fmt/format.h>
-#include <tinyxml2.h>
+
+#include "xml_writer.h"
 
 using Spectrum = aiColor3D;
 using Float = float;
 using Texture = std::string;
 
-using namespace tinyxml2;
 namespace fs = std::filesystem;
 
 template <typename T>
@@ -27,7 +28,7 @@ struct TextureOr {
   bool isTexture() const { return texture.has_value(); }
 };
 
-auto probeMaterialTexture(const aiMaterial *material, aiTextureType type) {
+inline auto probeMaterialTexture(const aiMaterial *material, aiTextureType type) {
   aiString path;
   if (material->GetTextureCount(type) != 0) {
     if (material->GetTexture(type, 0, &path) == aiReturn_SUCCESS) {
@@ -48,7 +49,7 @@ auto probeMaterialProperty(const aiMaterial *material, const char *pKey,
 }
 
 template<typename T>
-auto set_if(const std::optional<T> &opt, T &value){
+inline auto set_if(const std::optional<T> &opt, T &value){
   if(opt.has_value()){
     value = opt.value();
     return true;
@@ -57,7 +58,7 @@ auto set_if(const std::optional<T> &opt, T &value){
 }
 
 template<typename T>
-auto insert_if(const std::optional<T>& opt, std::set<T>& set){
+inline auto insert_if(const std::optional<T>& opt, std::set<T>& set){
   if(opt.has_value()){
     set.insert(opt.value());
     return true;
@@ -162,83 +163,89 @@ struct PrincipledBRDF {
   }
 };
 
-template <typename T>
-XMLElement* toXML(XMLDocument& doc, const TextureOr<T>& t){
+// maps a texture path as referenced by a material to the filename written
+// into the scene description; `raw` textures hold data instead of colors
+using TextureFilename = std::function<std::string(const Texture &, bool raw)>;
+
+inline std::string copiedTextureFilename(const Texture &texture, bool){
+  return "textures/" + fs::path(texture).filename().string();
+}
+
+template <typename Writer, typename T>
+void toXML(Writer& xml, const TextureOr<T>& t, const TextureFilename& textureFilename){
   if(t.isTexture()){
-    auto element = doc.NewElement("texture");
-    element->SetAttribute("type", "bitmap");
-    element->SetAttribute("name", t.type.c_str());
-    auto filenameNode = element->InsertNewChildElement("string");
-    std::string filename = "textures/" + fs::path(t.texture.value()).filename().string();
-    filenameNode->SetAttribute("name", "filename");
-    filenameNode->SetAttribute("value", filename.c_str());
-    return element;
+    xml.open("texture").attribute("type", "bitmap").attribute("name", t.type);
+    xml.property("string", "filename", textureFilename(t.texture.value(), false));
+    xml.close();
   }else{
     if constexpr (std::is_same_v<T, Float>){
-      auto element = doc.NewElement("float");
-      element->SetAttribute("name", t.type.c_str());
-      element->SetAttribute("value", t.value);
-      return element;
+      xml.open("float").attribute("name", t.type).attribute("value", t.value).close();
     }else{
-      auto element = doc.NewElement("rgb");
-      element->SetAttribute("name", t.type.c_str());
-      element->SetAttribute("value", fmt::format("{},{},{}", t.value.r, t.value.g, t.value.b).c_str());
-      return element;
+      xml.property("rgb", t.type, fmt::format("{},{},{}", t.value.r, t.value.g, t.value.b));
     }
   }
 }
 
-XMLElement* xmlBrdfMapWrapper(XMLDocument& doc, XMLElement* old, const std::optional<Texture> &tex, std::string mapKind){
-  if (!tex.has_value()){
-    return old;
-  }
-
-  auto element = doc.NewElement("bsdf");
-  element->SetAttribute("type", mapKind.c_str());
-    
-  auto texelement = element->InsertNewChildElement("texture");
-  texelement->SetAttribute("name", mapKind.c_str());
-  texelement->SetAttribute("type", "bitmap");
-    
-  auto noTransformNode = texelement->InsertNewChildElement("boolean");
-  noTransformNode->SetAttribute("name", "raw");
-  noTransformNode->SetAttribute("value", "true");
-    
-  auto filenameNode = texelement->InsertNewChildElement("string");
-  std::string filename = "textures/" + fs::path(tex.value()).filename().string();
-  filenameNode->SetAttribute("name", "filename");
-  filenameNode->SetAttribute("value", filename.c_str());
-    
-  element->InsertEndChild(old);
-  return element;
+template <typename Writer>
+void writeBrdfMapTexture(Writer& xml, const Texture &tex, const std::string &mapKind,
+                         const TextureFilename& textureFilename){
+  xml.open("texture").attribute("name", mapKind).attribute("type", "bitmap");
+  xml.property("boolean", "raw", "true");
+  xml.property("string", "filename", textureFilename(tex, true));
+  xml.close();
 }
 
-XMLElement* toXML(XMLDocument& doc, const PrincipledBRDF& brdf){
-  auto element = doc.NewElement("bsdf");
-  element->SetAttribute("type", "principled");
-  element->InsertEndChild(toXML(doc, brdf.base_color));
-  element->InsertEndChild(toXML(doc, brdf.roughness));
-  element->InsertEndChild(toXML(doc, brdf.anisotropic));
-  element->InsertEndChild(toXML(doc, brdf.metallic));
-  element->InsertEndChild(toXML(doc, brdf.specular));
-  element->InsertEndChild(toXML(doc, brdf.sheen));
-  element->InsertEndChild(toXML(doc, brdf.sheen_tint));
-  element->InsertEndChild(toXML(doc, brdf.flatness));
-  element->InsertEndChild(toXML(doc, brdf.clearcoat));
-  element->InsertEndChild(toXML(doc, brdf.clearcoat_gloss));
+template <typename Writer>
+void toXML(Writer& xml, const PrincipledBRDF& brdf,
+           const TextureFilename& textureFilename = copiedTextureFilename){
+  // wrappers are nested outside in: bumpmap, normalmap, twosided, principled.
+  // The outermost BSDF carries the id.
+  int depth = 0;
+  auto openBsdf = [&](const char *type){
+    xml.open("bsdf").attribute("type", type);
+    if(depth++ == 0){
+      xml.attribute("id", brdf.name);
+    }
+  };
 
+  if(brdf.bumpMap.has_value()){
+    openBsdf("bumpmap");
+    writeBrdfMapTexture(xml, brdf.bumpMap.value(), "bumpmap", textureFilename);
+  }
+  if(brdf.normalMap.has_value()){
+    openBsdf("normalmap");
+    writeBrdfMapTexture(xml, brdf.normalMap.value(), "normalmap", textureFilename);
+  }
   if(brdf.twoSided){
-	  auto old = element;
-    element = doc.NewElement("bsdf");
-    element->SetAttribute("type", "twosided");
-    element->InsertEndChild(old);
+    openBsdf("twosided");
   }
 
-  element = xmlBrdfMapWrapper(doc, element, brdf.normalMap, "normalmap");
-  element = xmlBrdfMapWrapper(doc, element, brdf.bumpMap, "bumpmap");
-  
-  element->SetAttribute("id", brdf.name.c_str());
-  return element;
+  openBsdf("principled");
+  toXML(xml, brdf.base_color, textureFilename);
+  toXML(xml, brdf.roughness, textureFilename);
+  toXML(xml, brdf.anisotropic, textureFilename);
+  toXML(xml, brdf.metallic, textureFilename);
+  toXML(xml, brdf.specular, textureFilename);
+  toXML(xml, brdf.sheen, textureFilename);
+  toXML(xml, brdf.sheen_tint, textureFilename);
+  toXML(xml, brdf.flatness, textureFilename);
+  toXML(xml, brdf.clearcoat, textureFilename);
+  toXML(xml, brdf.clearcoat_gloss, textureFilename);
+
+  while(depth-- > 0){
+    xml.close();
+  }
+}
+
+// Everything toXML() writes except the id; materials with the same
+// fingerprint render identically and can share a single bsdf
+inline std::string fingerprint(const PrincipledBRDF& brdf,
+                               const TextureFilename& textureFilename = copiedTextureFilename){
+  PrincipledBRDF anonymous = brdf;
+  anonymous.name.clear();
+  FingerprintWriter writer;
+  toXML(writer, anonymous, textureFilename);
+  return writer.fingerprint();
 }
 } // namespace Kontsuba
 
@@ -0,0 +1,134 @@
+#include "scene.h"
+
+#include <filesystem>
+#include <map>
+#include <random>
+#include <string>
+#include <type_traits>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include "import.h"
+#include "io_system.h"
+#include "mesh_processing.h"
+#include "principled_brdf.h"
+#include "scene_elements.h"
+#include "texture_processing.h"
+#include "utils.h"
+#include "xml_writer.h"
+
+namespace Kontsuba {
+
+// the views hand out Assimp's vertex arrays as plain floats
+static_assert(std::is_same_v<ai_real, float> && sizeof(aiVector3D) == 3 * sizeof(float),
+              "Assimp must be built with single precision");
+
+const std::string *Element::attribute(const std::string &key) const {
+  for (const auto &[name, value] : attributes) {
+    if (name == key) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+Scene::Scene() : m_importer(std::make_unique<Assimp::Importer>()) {}
+
+Scene::~Scene() {
+  if (!m_textureDirectory.empty()) {
+    std::error_code error;
+    fs::remove_all(m_textureDirectory, error);
+  }
+}
+
+std::shared_ptr<Scene> loadScene(const std::string &inputFile, const Options &options) {
+  fs::path inputPath = fs::canonical(expand(inputFile));
+  fs::path fromDir = inputPath.parent_path();
+
+  std::shared_ptr<Scene> result(new Scene());
+  result->m_importer->SetIOHandler(inputIOSystem(options).release());
+  const aiScene *scene =
+      importScene(*result->m_importer, inputPath, options, result->m_ownedScene);
+
+  ElementTreeWriter tree;
+  writeSceneDefaults(tree);
+  // textures are used in place, embedded ones are written once to a
+  // directory that is removed with the scene
+  std::map<const aiTexture *, std::string> embeddedFiles;
+  auto textureFilename = [&](const Texture &texture, bool) {
+    auto [embedded, index] = scene->GetEmbeddedTextureAndIndex(texture.c_str());
+    if (!embedded) {
+      return (fromDir / texture).lexically_normal().string();
+    }
+    std::string &file = embeddedFiles[embedded];
+    if (file.empty()) {
+      fs::path &directory = result->m_textureDirectory;
+      if (directory.empty()) {
+        std::random_device rd;
+        do {
+          directory = fs::temp_directory_path() / ("kontsuba-" + std::to_string(rd()));
+        } while (!fs::create_directory(directory));
+      }
+      // the index keeps textures of the same name apart
+      fs::path target =
+          directory / (std::to_string(index) + "-" + embeddedTextureName(embedded, index));
+      writeEmbeddedTexture(embedded, target);
+      file = target.string();
+    }
+    return file;
+  };
+  // identical materials share the bsdf of the first one, as in convert()
+  std::vector<std::string> materialIds;
+  std::map<std::string, std::string> idOfFingerprint;
+  for (size_t i = 0; i < scene->mNumMaterials; i++) {
+    auto brdf = PrincipledBRDF::fromMaterial(scene->mMaterials[i], true);
+    auto [known, added] =
+        idOfFingerprint.emplace(fingerprint(brdf, textureFilename), brdf.name);
+    if (added) {
+      toXML(tree, brdf, textureFilename);
+    }
+    materialIds.push_back(known->second);
+  }
+  result->m_elements = std::move(tree.elements());
+
+  auto instances = meshInstances(scene, options);
+  std::vector<const aiMesh *> meshes(scene->mMeshes, scene->mMeshes + scene->mNumMeshes);
+  if (options.mergeMeshes) {
+    result->m_mergedMeshes =
+        mergeMeshes(meshes, instances, materialIds, options.mergeMaxVertices);
+  }
+  for (size_t i = 0; i < meshes.size(); i++) {
+    if (instances[i].empty()) {
+      continue;
+    }
+    const aiMesh *mesh = meshes[i];
+    MeshView view;
+    view.name = mesh->mName.C_Str();
+    view.material = materialIds.at(mesh->mMaterialIndex);
+    view.vertexCount = mesh->mNumVertices;
+    view.positions = &mesh->mVertices[0].x;
+    if (mesh->HasNormals()) {
+      view.normals = &mesh->mNormals[0].x;
+    }
+    if (mesh->HasTextureCoords(0)) {
+      view.texcoords = &mesh->mTextureCoords[0][0].x;
+    }
+    try {
+      view.indices = triangleIndices(mesh);
+    } catch (std::exception &e) {
+      std::cout << "Warning: " << e.what() << std::endl;
+      continue;
+    }
+    if (options.removeDuplicateFaces) {
+      removeDuplicateFaces(mesh, view.indices);
+    }
+    for (const auto &m : instances[i]) {
+      view.transforms.push_back({m.a1, m.a2, m.a3, m.a4, m.b1, m.b2, m.b3, m.b4,
+                                 m.c1, m.c2, m.c3, m.c4, m.d1, m.d2, m.d3, m.d4});
+    }
+    result->m_meshes.push_back(std::move(view));
+  }
+  return result;
+}
+
+} // namespace Kontsuba
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <assimp/scene.h>
+#include <fmt/format.h>
+
+namespace Kontsuba {
+
+// Scene description parts shared by scene.xml and the in-memory scene. The
+// writer is either an XMLWriter or an ElementTreeWriter.
+
+template <typename Writer>
+void writeSceneDefaults(Writer &xml) {
+  xml.open("integrator").attribute("type", "path");
+  xml.property("integer", "max_depth", "3");
+  xml.close();
+
+  xml.open("emitter").attribute("type", "point");
+  xml.property("rgb", "intensity", "10");
+  xml.property("point", "position", "2, 2, 2");
+  xml.close();
+
+  xml.open("sensor").attribute("type", "perspective");
+  xml.property("float", "fov", "45");
+  xml.open("transform").attribute("name", "to_world");
+  xml.open("lookat")
+      .attribute("origin", "1, 1, 0")
+      .attribute("target", "0, 0, 0")
+      .attribute("up", "0, 0, 1")
+      .close();
+  xml.close();
+
+  xml.open("sampler").attribute("type", "independent");
+  xml.property("integer", "sample_count", "32");
+  xml.close();
+
+  xml.open("film").attribute("type", "hdrfilm");
+  xml.property("integer", "width", "512");
+  xml.property("integer", "height", "512");
+  xml.property("string", "pixel_format", "rgb");
+  xml.close();
+
+  xml.close();
+
+  // TODO remove this when we have proper emitter loading
+  xml.open("emitter").attribute("type", "constant");
+  xml.property("rgb", "radiance", "1.0");
+  xml.close();
+}
+
+template <typename Writer>
+void toXML(Writer &xml, const aiMatrix4x4 &m) {
+  xml.open("transform").attribute("name", "to_world");
+  xml.open("matrix")
+      .attribute("value", fmt::format("{} {} {} {} {} {} {} {} {} {} {} {} {} {} {} {}",
+                                      m.a1, m.a2, m.a3, m.a4, m.b1, m.b2, m.b3, m.b4,
+                                      m.c1, m.c2, m.c3, m.c4, m.d1, m.d2, m.d3, m.d4))
+      .close();
+  xml.close();
+}
+
+} // namespace Kontsuba
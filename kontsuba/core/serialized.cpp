@@ -0,0 +1,186 @@
+#include "serialized.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include <zlib.h>
+
+namespace Kontsuba {
+
+// vertex arrays are compressed as they are stored by Assimp
+static_assert(std::is_same_v<ai_real, float> && sizeof(aiVector3D) == 3 * sizeof(float),
+              "Assimp must be built with single precision");
+
+namespace {
+
+constexpr uint16_t kFileFormatHeader = 0x041C;
+constexpr uint16_t kFileFormatVersion = 0x0004;
+
+// TriMesh flags as defined by Mitsuba
+constexpr uint32_t kHasNormals = 0x0001;
+constexpr uint32_t kHasTexcoords = 0x0002;
+constexpr uint32_t kSinglePrecision = 0x1000;
+
+template <typename T>
+void put(std::vector<char> &buffer, const T &value) {
+  auto bytes = reinterpret_cast<const char *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+// Compresses data handed over in pieces straight into the end of `out`, so
+// the uncompressed record is never assembled in memory
+class Deflater {
+public:
+  // `inputSize` is the total number of bytes that will be written
+  Deflater(std::vector<char> &out, uint64_t inputSize) : m_out(out) {
+    if (deflateInit(&m_stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      throw std::runtime_error("failed to initialize zlib");
+    }
+    // the output then grows without reallocating
+    if (inputSize <= std::numeric_limits<uLong>::max()) {
+      m_out.reserve(m_out.size() + deflateBound(&m_stream, static_cast<uLong>(inputSize)));
+    }
+  }
+
+  ~Deflater() { deflateEnd(&m_stream); }
+
+  Deflater(const Deflater &) = delete;
+  Deflater &operator=(const Deflater &) = delete;
+
+  void write(const void *data, size_t size) {
+    auto bytes = static_cast<const char *>(data);
+    // zlib counts in uInt, so feed large inputs in slices
+    while (size > 0) {
+      size_t slice = std::min(size, kSliceSize);
+      m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(bytes));
+      m_stream.avail_in = static_cast<uInt>(slice);
+      run(Z_NO_FLUSH);
+      bytes += slice;
+      size -= slice;
+    }
+  }
+
+  template <typename T>
+  void put(const T &value) {
+    write(&value, sizeof(T));
+  }
+
+  void finish() { run(Z_FINISH); }
+
+private:
+  static constexpr size_t kSliceSize = 1 << 20;
+
+  // deflate until the input is consumed, or everything is flushed
+  void run(int flush) {
+    int result;
+    do {
+      size_t used = m_out.size();
+      m_out.resize(used + kSliceSize);
+      m_stream.next_out = reinterpret_cast<Bytef *>(m_out.data() + used);
+      m_stream.avail_out = static_cast<uInt>(kSliceSize);
+      result = deflate(&m_stream, flush);
+      m_out.resize(used + (kSliceSize - m_stream.avail_out));
+    } while (m_stream.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+  }
+
+  std::vector<char> &m_out;
+  z_stream m_stream{};
+};
+
+} // namespace
+
+SerializedWriter::SerializedWriter(const std::string &filename)
+    : m_filename(filename),
+      m_stream(filename, std::ios::out | std::ios::binary) {
+  if (m_stream.fail()) {
+    throw std::runtime_error("failed to open " + filename);
+  }
+}
+
+SerializedWriter::~SerializedWriter() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+std::vector<char> SerializedWriter::encode(const aiMesh *mesh,
+                                           const std::vector<uint32_t> &indices) {
+  const bool hasNormals = mesh->HasNormals();
+  const bool hasTexcoords = mesh->HasTextureCoords(0);
+  uint32_t flags = kSinglePrecision;
+  if (hasNormals) {
+    flags |= kHasNormals;
+  }
+  if (hasTexcoords) {
+    flags |= kHasTexcoords;
+  }
+
+  const uint64_t vertexCount = mesh->mNumVertices;
+  const uint64_t faceCount = indices.size() / 3;
+  uint64_t payloadSize = sizeof(flags) + mesh->mName.length + 1 + 2 * sizeof(uint64_t);
+  payloadSize += vertexCount * sizeof(aiVector3D) * (hasNormals ? 2 : 1);
+  payloadSize += hasTexcoords ? vertexCount * 2 * sizeof(float) : 0;
+  payloadSize += indices.size() * sizeof(uint32_t);
+
+  std::vector<char> shape;
+  put(shape, kFileFormatHeader);
+  put(shape, kFileFormatVersion);
+  Deflater deflater(shape, payloadSize);
+  deflater.put(flags);
+  deflater.write(mesh->mName.C_Str(), mesh->mName.length + 1);
+  deflater.put(vertexCount);
+  deflater.put(faceCount);
+
+  // positions and normals are compressed from Assimp's arrays as they are,
+  // only texture coordinates need to be packed
+  deflater.write(mesh->mVertices, vertexCount * sizeof(aiVector3D));
+  if (hasNormals) {
+    deflater.write(mesh->mNormals, vertexCount * sizeof(aiVector3D));
+  }
+  if (hasTexcoords) {
+    constexpr size_t kPackedVertices = 1 << 16;
+    std::vector<float> packed;
+    packed.reserve(2 * std::min<size_t>(vertexCount, kPackedVertices));
+    for (size_t start = 0; start < vertexCount; start += kPackedVertices) {
+      size_t end = std::min<size_t>(vertexCount, start + kPackedVertices);
+      packed.clear();
+      for (size_t i = start; i < end; i++) {
+        packed.push_back(mesh->mTextureCoords[0][i].x);
+        packed.push_back(mesh->mTextureCoords[0][i].y);
+      }
+      deflater.write(packed.data(), packed.size() * sizeof(float));
+    }
+  }
+  deflater.write(indices.data(), indices.size() * sizeof(uint32_t));
+  deflater.finish();
+  return shape;
+}
+
+uint32_t SerializedWriter::append(const std::vector<char> &shape) {
+  m_offsets.push_back(static_cast<uint64_t>(m_stream.tellp()));
+  m_stream.write(shape.data(), shape.size());
+  if (m_stream.fail()) {
+    throw std::runtime_error("failed to write " + m_filename);
+  }
+  return static_cast<uint32_t>(m_offsets.size() - 1);
+}
+
+void SerializedWriter::close() {
+  if (!m_stream.is_open()) {
+    return;
+  }
+  for (auto offset : m_offsets) {
+    m_stream.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+  }
+  auto count = static_cast<uint32_t>(m_offsets.size());
+  m_stream.write(reinterpret_cast<const char *>(&count), sizeof(count));
+  m_stream.close();
+  if (m_stream.fail()) {
+    throw std::runtime_error("failed to write " + m_filename);
+  }
+}
+
+} // namespace Kontsuba
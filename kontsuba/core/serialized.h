@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <assimp/mesh.h>
+
+namespace Kontsuba {
+
+// Writer for Mitsuba's `serialized` mesh format
+// https://mitsuba.readthedocs.io/en/latest/src/generated/plugins_shapes.html#serialized-mesh-loader
+//
+// A single file holds any number of shapes, each stored as a small header
+// followed by a zlib compressed blob. A table of shape offsets at the end of
+// the file allows Mitsuba to seek to the shape selected by `shape_index`.
+// All values are written in native byte order, which the format expects to be
+// little endian.
+class SerializedWriter {
+public:
+  explicit SerializedWriter(const std::string &filename);
+  ~SerializedWriter();
+
+  // compress a single triangle mesh into a self-contained shape record,
+  // `indices` holds three vertex indices per face
+  static std::vector<char> encode(const aiMesh *mesh,
+                                  const std::vector<uint32_t> &indices);
+
+  // append an encoded shape and return its shape index
+  uint32_t append(const std::vector<char> &shape);
+
+  // write the offset table; called by the destructor if omitted
+  void close();
+
+private:
+  std::string m_filename;
+  std::ofstream m_stream;
+  std::vector<uint64_t> m_offsets;
+};
+
+} // namespace Kontsuba
@@ -0,0 +1,192 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <fmt/core.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace Kontsuba {
+
+namespace {
+
+constexpr size_t kSlowestMeshes = 5;
+
+std::string jsonString(const std::string &value) {
+  std::string out = "\"";
+  for (char c : value) {
+    switch (c) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        out += fmt::format("\\u{:04x}", static_cast<int>(c));
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out + "\"";
+}
+
+double mebibytes(uint64_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+} // namespace
+
+uint64_t currentResidentBytes() {
+#if defined(__linux__)
+  // sizes in pages: total program size, then resident set
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0, resident = 0;
+  if (!(statm >> size >> resident)) {
+    return 0;
+  }
+  return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#elif defined(__APPLE__)
+  mach_task_basic_info_data_t info{};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) {
+    return 0;
+  }
+  return info.resident_size;
+#else
+  return 0;
+#endif
+}
+
+double ConversionStats::seconds() const {
+  double total = 0.0;
+  for (const auto &phase : phases) {
+    total += phase.seconds;
+  }
+  return total;
+}
+
+uint64_t ConversionStats::bytesWritten() const {
+  uint64_t total = 0;
+  for (const auto &phase : phases) {
+    total += phase.bytesWritten;
+  }
+  return total;
+}
+
+std::string ConversionStats::summary() const {
+  std::string out = fmt::format("Statistics for {}{}\n", inputFile,
+                                cached ? " (restored from cache)" : "");
+  out += fmt::format("  {:<20}{:>10}{:>14}{:>14}{:>14}\n", "phase", "time",
+                     "written", "RSS at end", "RSS change");
+  for (const auto &phase : phases) {
+    out += fmt::format("  {:<20}{:>9.3f}s{:>10.1f} MiB{:>10.1f} MiB{:>+10.1f} MiB\n",
+                       phase.name, phase.seconds, mebibytes(phase.bytesWritten),
+                       mebibytes(phase.residentBytesEnd),
+                       mebibytes(phase.residentBytesEnd) -
+                           mebibytes(phase.residentBytesStart));
+  }
+  out += fmt::format("  {:<20}{:>9.3f}s{:>10.1f} MiB\n", "total", seconds(),
+                     mebibytes(bytesWritten()));
+
+  if (meshes.empty()) {
+    return out;
+  }
+  uint64_t vertices = 0, faces = 0, missesBefore = 0, missesAfter = 0;
+  for (const auto &mesh : meshes) {
+    vertices += mesh.vertices;
+    faces += mesh.faces;
+    missesBefore += mesh.cacheMissesBefore;
+    missesAfter += mesh.cacheMissesAfter;
+  }
+  out += fmt::format("  {} meshes, {} vertices, {} faces\n", meshes.size(),
+                     vertices, faces);
+  if (missesBefore != 0 && faces != 0) {
+    out += fmt::format("  vertex cache miss ratio (ACMR) {:.3f} -> {:.3f}\n",
+                       static_cast<double>(missesBefore) / faces,
+                       static_cast<double>(missesAfter) / faces);
+  }
+
+  std::vector<const MeshStats *> slowest;
+  for (const auto &mesh : meshes) {
+    slowest.push_back(&mesh);
+  }
+  size_t count = std::min(slowest.size(), kSlowestMeshes);
+  std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+                    [](const MeshStats *a, const MeshStats *b) {
+                      return a->seconds > b->seconds;
+                    });
+  out += "  slowest meshes:\n";
+  for (size_t i = 0; i < count; i++) {
+    const MeshStats &mesh = *slowest[i];
+    out += fmt::format("    {:<30}{:>9.3f}s{:>10.1f} MiB  {} vertices, {} faces{}\n",
+                       mesh.file, mesh.seconds, mebibytes(mesh.bytesWritten),
+                       mesh.vertices, mesh.faces,
+                       mesh.chunks > 1 ? fmt::format(", {} chunks", mesh.chunks) : "");
+  }
+  return out;
+}
+
+std::string ConversionStats::json() const {
+  std::string out = "{\n";
+  out += fmt::format("  \"input\": {},\n", jsonString(inputFile));
+  out += fmt::format("  \"cached\": {},\n", cached);
+  out += fmt::format("  \"seconds\": {:.6f},\n", seconds());
+  out += fmt::format("  \"bytes_written\": {},\n", bytesWritten());
+
+  out += "  \"phases\": [";
+  for (size_t i = 0; i < phases.size(); i++) {
+    const PhaseStats &phase = phases[i];
+    out += fmt::format("{}\n    {{\"name\": {}, \"seconds\": {:.6f}, "
+                       "\"bytes_written\": {}, \"rss_start_bytes\": {}, "
+                       "\"rss_end_bytes\": {}}}",
+                       i ? "," : "", jsonString(phase.name), phase.seconds,
+                       phase.bytesWritten, phase.residentBytesStart,
+                       phase.residentBytesEnd);
+  }
+  out += phases.empty() ? "],\n" : "\n  ],\n";
+
+  out += "  \"meshes\": [";
+  for (size_t i = 0; i < meshes.size(); i++) {
+    const MeshStats &mesh = meshes[i];
+    out += fmt::format("{}\n    {{\"name\": {}, \"file\": {}, \"vertices\": {}, "
+                       "\"faces\": {}, \"chunks\": {}, \"cache_misses_before\": {}, "
+                       "\"cache_misses_after\": {}, \"bytes_written\": {}, "
+                       "\"seconds\": {:.6f}}}",
+                       i ? "," : "", jsonString(mesh.name), jsonString(mesh.file),
+                       mesh.vertices, mesh.faces, mesh.chunks, mesh.cacheMissesBefore,
+                       mesh.cacheMissesAfter, mesh.bytesWritten, mesh.seconds);
+  }
+  out += meshes.empty() ? "]\n" : "\n  ]\n";
+  return out + "}\n";
+}
+
+PhaseTimer::PhaseTimer(ConversionStats &stats, std::string name)
+    : m_stats(&stats), m_name(std::move(name)),
+      m_start(std::chrono::steady_clock::now()),
+      m_residentBytesStart(currentResidentBytes()) {}
+
+PhaseTimer::~PhaseTimer() { stop(); }
+
+void PhaseTimer::stop() {
+  if (!m_stats) {
+    return;
+  }
+  PhaseStats phase;
+  phase.name = std::move(m_name);
+  phase.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - m_start)
+                      .count();
+  phase.bytesWritten = m_bytesWritten;
+  phase.residentBytesStart = m_residentBytesStart;
+  phase.residentBytesEnd = currentResidentBytes();
+  m_stats->phases.push_back(std::move(phase));
+  m_stats = nullptr;
+}
+
+} // namespace Kontsuba
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Kontsuba {
+
+// Current resident set size of the process in bytes, 0 where unsupported
+uint64_t currentResidentBytes();
+
+struct PhaseStats {
+  std::string name;
+  double seconds = 0.0;
+  uint64_t bytesWritten = 0;
+  // resident set size of the process when the phase started and ended. It
+  // covers the whole process, so conversions running concurrently in it
+  // (convertMany(), --batch) are included.
+  uint64_t residentBytesStart = 0;
+  uint64_t residentBytesEnd = 0;
+};
+
+struct MeshStats {
+  std::string name;
+  std::string file;
+  uint64_t vertices = 0;
+  uint64_t faces = 0;
+  uint64_t bytesWritten = 0;
+  double seconds = 0.0;
+  // number of shapes the mesh was split into, `file` is the first one
+  uint32_t chunks = 1;
+  // simulated vertex cache misses before and after reordering the faces,
+  // both 0 unless Options::optimizeMeshOrder is set
+  uint64_t cacheMissesBefore = 0;
+  uint64_t cacheMissesAfter = 0;
+};
+
+// Wall times, output sizes and memory use of a single conversion
+struct ConversionStats {
+  std::string inputFile;
+  bool cached = false;
+  std::vector<PhaseStats> phases;
+  std::vector<MeshStats> meshes;
+
+  double seconds() const;
+  uint64_t bytesWritten() const;
+
+  // human readable report, lists the slowest meshes only
+  std::string summary() const;
+  std::string json() const;
+};
+
+// Appends a phase to `stats` when stopped or destroyed
+class PhaseTimer {
+public:
+  PhaseTimer(ConversionStats &stats, std::string name);
+  ~PhaseTimer();
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+  void addBytes(uint64_t bytes) { m_bytesWritten += bytes; }
+  void stop();
+
+private:
+  ConversionStats *m_stats;
+  std::string m_name;
+  std::chrono::steady_clock::time_point m_start;
+  uint64_t m_residentBytesStart;
+  uint64_t m_bytesWritten = 0;
+};
+
+} // namespace Kontsuba
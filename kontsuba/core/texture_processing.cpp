@@ -0,0 +1,527 @@
+#include "texture_processing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <assimp/texture.h>
+#include "hash.h"
+
+// stb_image is bundled with assimp; STB_IMAGE_STATIC keeps our copy of the
+// implementation from clashing with assimp's. Most of its static functions
+// go unused here, which is not worth a warning each.
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#elif defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4505) // unreferenced function with internal linkage
+#endif
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#elif defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+namespace Kontsuba {
+namespace fs = std::filesystem;
+
+namespace {
+
+// linear float pixels, `channels` interleaved values per pixel
+struct Image {
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  std::vector<float> pixels;
+
+  float &at(int x, int y, int c) {
+    return pixels[(static_cast<size_t>(y) * width + x) * channels + c];
+  }
+};
+
+float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f
+                           : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+// stb_image entry points for a file
+struct FileReader {
+  std::string filename;
+
+  const std::string &name() const { return filename; }
+  bool info() const {
+    int width, height, channels;
+    return stbi_info(filename.c_str(), &width, &height, &channels);
+  }
+  bool isHdr() const { return stbi_is_hdr(filename.c_str()); }
+  bool is16Bit() const { return stbi_is_16_bit(filename.c_str()); }
+  float *loadf(Image &image) const {
+    return stbi_loadf(filename.c_str(), &image.width, &image.height, &image.channels, 0);
+  }
+  void *load16(Image &image) const {
+    return stbi_load_16(filename.c_str(), &image.width, &image.height, &image.channels, 0);
+  }
+  void *load(Image &image) const {
+    return stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, 0);
+  }
+};
+
+// stb_image entry points for a compressed embedded texture
+struct MemoryReader {
+  std::string filename;
+  const stbi_uc *data;
+  int size;
+
+  const std::string &name() const { return filename; }
+  bool info() const {
+    int width, height, channels;
+    return stbi_info_from_memory(data, size, &width, &height, &channels);
+  }
+  bool isHdr() const { return stbi_is_hdr_from_memory(data, size); }
+  bool is16Bit() const { return stbi_is_16_bit_from_memory(data, size); }
+  float *loadf(Image &image) const {
+    return stbi_loadf_from_memory(data, size, &image.width, &image.height,
+                                  &image.channels, 0);
+  }
+  void *load16(Image &image) const {
+    return stbi_load_16_from_memory(data, size, &image.width, &image.height,
+                                    &image.channels, 0);
+  }
+  void *load(Image &image) const {
+    return stbi_load_from_memory(data, size, &image.width, &image.height,
+                                 &image.channels, 0);
+  }
+};
+
+MemoryReader memoryReader(const TextureSource &source) {
+  return {source.path.string(), reinterpret_cast<const stbi_uc *>(source.embedded->pcData),
+          static_cast<int>(source.embedded->mWidth)};
+}
+
+bool isCompressed(const aiTexture *texture) { return texture->mHeight == 0; }
+
+template <typename Reader>
+Image decode(const Reader &reader, bool raw) {
+  Image image;
+  auto failed = [&] {
+    return std::runtime_error("failed to decode " + reader.name() + ": " +
+                              stbi_failure_reason());
+  };
+
+  if (reader.isHdr()) {
+    std::unique_ptr<float, void (*)(void *)> data(reader.loadf(image), stbi_image_free);
+    if (!data) {
+      throw failed();
+    }
+    image.pixels.assign(data.get(), data.get() + static_cast<size_t>(image.width) *
+                                                     image.height * image.channels);
+    return image;
+  }
+
+  // integer formats store sRGB encoded colors, alpha is always linear
+  bool is16Bit = reader.is16Bit();
+  float scale = is16Bit ? 1.0f / 65535.0f : 1.0f / 255.0f;
+  void *data = is16Bit ? reader.load16(image) : reader.load(image);
+  if (!data) {
+    throw failed();
+  }
+  std::unique_ptr<void, void (*)(void *)> owner(data, stbi_image_free);
+
+  size_t count = static_cast<size_t>(image.width) * image.height * image.channels;
+  image.pixels.resize(count);
+  bool hasAlpha = image.channels == 2 || image.channels == 4;
+  for (size_t i = 0; i < count; i++) {
+    float value = is16Bit ? static_cast<const uint16_t *>(data)[i] * scale
+                          : static_cast<const uint8_t *>(data)[i] * scale;
+    bool alpha = hasAlpha && i % image.channels == static_cast<size_t>(image.channels - 1);
+    image.pixels[i] = raw || alpha ? value : srgbToLinear(value);
+  }
+  return image;
+}
+
+// raw embedded texels are 8 bit BGRA
+Image decodeTexels(const aiTexture *texture, bool raw) {
+  Image image;
+  image.width = static_cast<int>(texture->mWidth);
+  image.height = static_cast<int>(texture->mHeight);
+  image.channels = 4;
+  size_t count = static_cast<size_t>(image.width) * image.height;
+  image.pixels.resize(4 * count);
+  for (size_t i = 0; i < count; i++) {
+    const aiTexel &texel = texture->pcData[i];
+    float *pixel = &image.pixels[4 * i];
+    pixel[0] = texel.r / 255.0f;
+    pixel[1] = texel.g / 255.0f;
+    pixel[2] = texel.b / 255.0f;
+    pixel[3] = texel.a / 255.0f;
+    if (!raw) {
+      for (int c = 0; c < 3; c++) {
+        pixel[c] = srgbToLinear(pixel[c]);
+      }
+    }
+  }
+  return image;
+}
+
+// uncompressed 32 bit TGA header, stored top to bottom like aiTexture
+std::vector<char> tgaHeader(const aiTexture *texture) {
+  if (texture->mWidth > 0xffff || texture->mHeight > 0xffff) {
+    throw std::runtime_error("embedded texture is too large for TGA");
+  }
+  std::vector<char> header(18, 0);
+  header[2] = 2; // uncompressed true color
+  header[12] = static_cast<char>(texture->mWidth & 0xff);
+  header[13] = static_cast<char>(texture->mWidth >> 8);
+  header[14] = static_cast<char>(texture->mHeight & 0xff);
+  header[15] = static_cast<char>(texture->mHeight >> 8);
+  header[16] = 32;
+  header[17] = 0x28; // 8 alpha bits, top left origin
+  return header;
+}
+
+size_t texelBytes(const aiTexture *texture) {
+  return static_cast<size_t>(texture->mWidth) * texture->mHeight * sizeof(aiTexel);
+}
+
+// Reads the bytes of a texture written as is, front to back
+class ContentReader {
+public:
+  explicit ContentReader(const TextureSource &source) {
+    if (!source.embedded) {
+      m_file.open(source.path, std::ios::in | std::ios::binary);
+      if (m_file.fail()) {
+        throw std::runtime_error("failed to open " + source.path.string());
+      }
+      return;
+    }
+    auto data = reinterpret_cast<const char *>(source.embedded->pcData);
+    if (isCompressed(source.embedded)) {
+      m_parts = {{data, source.embedded->mWidth}};
+    } else {
+      m_header = tgaHeader(source.embedded);
+      m_parts = {{m_header.data(), m_header.size()}, {data, texelBytes(source.embedded)}};
+    }
+  }
+
+  // fills `buffer` as far as the contents reach, returns the bytes read
+  size_t read(char *buffer, size_t size) {
+    if (m_file.is_open()) {
+      m_file.read(buffer, size);
+      return static_cast<size_t>(m_file.gcount());
+    }
+    size_t done = 0;
+    while (done < size && m_part < m_parts.size()) {
+      auto [data, length] = m_parts[m_part];
+      size_t count = std::min(size - done, length - m_offset);
+      std::memcpy(buffer + done, data + m_offset, count);
+      done += count;
+      m_offset += count;
+      if (m_offset == length) {
+        m_part++;
+        m_offset = 0;
+      }
+    }
+    return done;
+  }
+
+private:
+  std::ifstream m_file;
+  std::vector<char> m_header;
+  std::vector<std::pair<const char *, size_t>> m_parts;
+  size_t m_part = 0;
+  size_t m_offset = 0;
+};
+
+void writeFile(const fs::path &target, const std::vector<const char *> &parts,
+               const std::vector<size_t> &sizes) {
+  // never write through an existing link into its target
+  std::error_code error;
+  fs::remove(target, error);
+  std::ofstream file(target, std::ios::out | std::ios::binary);
+  for (size_t i = 0; i < parts.size(); i++) {
+    file.write(parts[i], sizes[i]);
+  }
+  file.close();
+  if (file.fail()) {
+    throw std::runtime_error("failed to write " + target.string());
+  }
+}
+
+// box filter to half the size, odd edges average the remaining pixels
+Image halve(Image &image) {
+  Image result;
+  result.width = std::max(1, (image.width + 1) / 2);
+  result.height = std::max(1, (image.height + 1) / 2);
+  result.channels = image.channels;
+  result.pixels.resize(static_cast<size_t>(result.width) * result.height * result.channels);
+  for (int y = 0; y < result.height; y++) {
+    int y0 = 2 * y, y1 = std::min(2 * y + 1, image.height - 1);
+    for (int x = 0; x < result.width; x++) {
+      int x0 = 2 * x, x1 = std::min(2 * x + 1, image.width - 1);
+      for (int c = 0; c < image.channels; c++) {
+        result.at(x, y, c) = 0.25f * (image.at(x0, y0, c) + image.at(x1, y0, c) +
+                                      image.at(x0, y1, c) + image.at(x1, y1, c));
+      }
+    }
+  }
+  return result;
+}
+
+uint16_t toHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) {
+    // infinity or NaN
+    return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  }
+  if (exponent >= 31) {
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return static_cast<uint16_t>(sign);
+    }
+    // subnormal half
+    mantissa |= 0x800000;
+    uint32_t shift = static_cast<uint32_t>(14 - exponent);
+    uint32_t half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1) {
+      half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+  uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  // round to nearest, a carry correctly moves into the exponent
+  if (mantissa & 0x1000) {
+    half++;
+  }
+  return static_cast<uint16_t>(half);
+}
+
+template <typename T>
+void put(std::vector<char> &buffer, const T &value) {
+  auto bytes = reinterpret_cast<const char *>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void putAttribute(std::vector<char> &header, const char *name, const char *type,
+                  const std::vector<char> &value) {
+  header.insert(header.end(), name, name + std::strlen(name) + 1);
+  header.insert(header.end(), type, type + std::strlen(type) + 1);
+  put(header, static_cast<int32_t>(value.size()));
+  header.insert(header.end(), value.begin(), value.end());
+}
+
+// Single part scanline OpenEXR with uncompressed half channels. Values are
+// little endian, like the rest of our writers assume.
+std::vector<char> encodeExr(const Image &image) {
+  // channels are stored in alphabetical order
+  static const char *const kChannelNames[4][4] = {
+      {"Y"}, {"A", "Y"}, {"B", "G", "R"}, {"A", "B", "G", "R"}};
+  static const int kChannelOrder[4][4] = {{0}, {1, 0}, {2, 1, 0}, {3, 2, 1, 0}};
+  const int channels = image.channels;
+  const char *const *names = kChannelNames[channels - 1];
+  const int *order = kChannelOrder[channels - 1];
+
+  std::vector<char> file;
+  put(file, static_cast<int32_t>(20000630));
+  put(file, static_cast<int32_t>(2));
+
+  std::vector<char> value;
+  for (int c = 0; c < channels; c++) {
+    value.insert(value.end(), names[c], names[c] + std::strlen(names[c]) + 1);
+    put(value, static_cast<int32_t>(1)); // HALF
+    put(value, static_cast<int32_t>(0)); // pLinear and reserved
+    put(value, static_cast<int32_t>(1)); // x sampling
+    put(value, static_cast<int32_t>(1)); // y sampling
+  }
+  value.push_back(0);
+  putAttribute(file, "channels", "chlist", value);
+  putAttribute(file, "compression", "compression", {0});
+
+  value.clear();
+  for (int32_t coordinate : {0, 0, image.width - 1, image.height - 1}) {
+    put(value, coordinate);
+  }
+  putAttribute(file, "dataWindow", "box2i", value);
+  putAttribute(file, "displayWindow", "box2i", value);
+  putAttribute(file, "lineOrder", "lineOrder", {0});
+
+  value.clear();
+  put(value, 1.0f);
+  putAttribute(file, "pixelAspectRatio", "float", value);
+  putAttribute(file, "screenWindowWidth", "float", value);
+  value.clear();
+  put(value, 0.0f);
+  put(value, 0.0f);
+  putAttribute(file, "screenWindowCenter", "v2f", value);
+  file.push_back(0);
+
+  // one block per scanline
+  const int32_t lineBytes = image.width * channels * static_cast<int32_t>(sizeof(uint16_t));
+  uint64_t offset = file.size() + sizeof(uint64_t) * image.height;
+  for (int y = 0; y < image.height; y++) {
+    put(file, offset);
+    offset += 2 * sizeof(int32_t) + lineBytes;
+  }
+  file.reserve(offset);
+  for (int y = 0; y < image.height; y++) {
+    put(file, static_cast<int32_t>(y));
+    put(file, lineBytes);
+    const float *row = image.pixels.data() + static_cast<size_t>(y) * image.width * channels;
+    for (int c = 0; c < channels; c++) {
+      for (int x = 0; x < image.width; x++) {
+        put(file, toHalf(row[x * channels + order[c]]));
+      }
+    }
+  }
+  return file;
+}
+
+// Radiance RGBE with flat scanlines, alpha is dropped
+std::vector<char> encodeRgbe(const Image &image) {
+  std::string header = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " +
+                       std::to_string(image.height) + " +X " +
+                       std::to_string(image.width) + "\n";
+  std::vector<char> file(header.begin(), header.end());
+  file.reserve(file.size() + 4 * static_cast<size_t>(image.width) * image.height);
+
+  const int channels = image.channels;
+  const bool gray = channels < 3;
+  for (size_t i = 0; i < static_cast<size_t>(image.width) * image.height; i++) {
+    const float *pixel = image.pixels.data() + i * channels;
+    float rgb[3] = {pixel[0], gray ? pixel[0] : pixel[1], gray ? pixel[0] : pixel[2]};
+    float largest = std::max({rgb[0], rgb[1], rgb[2]});
+    if (largest < 1e-32f) {
+      file.insert(file.end(), 4, 0);
+      continue;
+    }
+    int exponent;
+    float scale = std::frexp(largest, &exponent) * 256.0f / largest;
+    for (float component : rgb) {
+      file.push_back(static_cast<char>(static_cast<uint8_t>(std::max(0.0f, component) * scale)));
+    }
+    file.push_back(static_cast<char>(exponent + 128));
+  }
+  return file;
+}
+
+} // namespace
+
+std::string textureExtension(TextureFormat format) {
+  switch (format) {
+  case TextureFormat::Exr:
+    return ".exr";
+  case TextureFormat::Rgbe:
+    return ".hdr";
+  case TextureFormat::Original:
+    break;
+  }
+  throw std::logic_error("original textures keep their extension");
+}
+
+std::string embeddedTextureName(const aiTexture *texture, unsigned int index) {
+  fs::path name = fs::path(texture->mFilename.C_Str()).filename();
+  if (name.stem().empty()) {
+    name = "texture" + std::to_string(index);
+  }
+  if (!isCompressed(texture)) {
+    name.replace_extension(".tga");
+  } else if (name.extension().empty() && texture->achFormatHint[0] != '\0') {
+    name.replace_extension(std::string(".") + texture->achFormatHint);
+  }
+  return name.string();
+}
+
+uint64_t textureSize(const TextureSource &source) {
+  if (!source.embedded) {
+    return fs::file_size(source.path);
+  }
+  if (isCompressed(source.embedded)) {
+    return source.embedded->mWidth;
+  }
+  return tgaHeader(source.embedded).size() + texelBytes(source.embedded);
+}
+
+std::string hashTexture(const TextureSource &source) {
+  if (!source.embedded) {
+    return hashFile(source.path);
+  }
+  Hasher hasher;
+  if (isCompressed(source.embedded)) {
+    hasher.update(source.embedded->pcData, source.embedded->mWidth);
+  } else {
+    auto header = tgaHeader(source.embedded);
+    hasher.update(header.data(), header.size());
+    hasher.update(source.embedded->pcData, texelBytes(source.embedded));
+  }
+  return hasher.hexdigest();
+}
+
+bool sameContents(const TextureSource &a, const TextureSource &b) {
+  ContentReader readerA(a), readerB(b);
+  std::vector<char> bufferA(1 << 20), bufferB(1 << 20);
+  while (true) {
+    size_t countA = readerA.read(bufferA.data(), bufferA.size());
+    size_t countB = readerB.read(bufferB.data(), bufferB.size());
+    if (countA != countB || std::memcmp(bufferA.data(), bufferB.data(), countA) != 0) {
+      return false;
+    }
+    if (countA == 0) {
+      return true;
+    }
+  }
+}
+
+uint64_t writeEmbeddedTexture(const aiTexture *texture, const fs::path &target) {
+  auto texels = reinterpret_cast<const char *>(texture->pcData);
+  if (isCompressed(texture)) {
+    writeFile(target, {texels}, {texture->mWidth});
+    return texture->mWidth;
+  }
+  auto header = tgaHeader(texture);
+  writeFile(target, {header.data(), texels}, {header.size(), texelBytes(texture)});
+  return header.size() + texelBytes(texture);
+}
+
+bool canTranscode(const TextureSource &source) {
+  if (!source.embedded) {
+    return FileReader{source.path.string()}.info();
+  }
+  return !isCompressed(source.embedded) || memoryReader(source).info();
+}
+
+uint64_t transcodeTexture(const TextureSource &source, const fs::path &target,
+                          TextureFormat format, bool raw, unsigned int maxResolution) {
+  Image image;
+  if (!source.embedded) {
+    image = decode(FileReader{source.path.string()}, raw);
+  } else if (isCompressed(source.embedded)) {
+    image = decode(memoryReader(source), raw);
+  } else {
+    image = decodeTexels(source.embedded, raw);
+  }
+  while (maxResolution > 0 &&
+         static_cast<unsigned int>(std::max(image.width, image.height)) > maxResolution) {
+    image = halve(image);
+  }
+
+  auto encoded = format == TextureFormat::Exr ? encodeExr(image) : encodeRgbe(image);
+  writeFile(target, {encoded.data()}, {encoded.size()});
+  return encoded.size();
+}
+
+} // namespace Kontsuba
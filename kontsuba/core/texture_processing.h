@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "converter.h"
+
+struct aiTexture;
+
+namespace Kontsuba {
+
+// file extension (with dot) of textures written in `format`
+std::string textureExtension(TextureFormat format);
+
+// A texture read from the file at `path`, or `embedded` in the imported
+// scene, in which case `path` is just the name it is written as
+struct TextureSource {
+  std::filesystem::path path;
+  const aiTexture *embedded = nullptr;
+};
+
+// name (with extension) of embedded texture `index` when written as is
+std::string embeddedTextureName(const aiTexture *texture, unsigned int index);
+
+// number of bytes and hash (as hashFile()) of the texture written as is
+uint64_t textureSize(const TextureSource &source);
+std::string hashTexture(const TextureSource &source);
+
+// whether both textures written as is consist of the same bytes, for
+// confirming duplicates found by size and hash
+bool sameContents(const TextureSource &a, const TextureSource &b);
+
+// Writes an embedded texture as is: compressed textures verbatim and raw
+// texels as uncompressed TGA. Returns the number of bytes written.
+uint64_t writeEmbeddedTexture(const aiTexture *texture,
+                              const std::filesystem::path &target);
+
+// whether transcodeTexture() can decode `source`, only reads its header
+bool canTranscode(const TextureSource &source);
+
+// Decodes `source` and writes it to `target` in `format`, which must not be
+// TextureFormat::Original. Unless `raw` is set, 8 and 16 bit sources are
+// converted from sRGB to linear values so Mitsuba, which treats float
+// formats as linear, shows the same colors. Images larger than
+// `maxResolution` (0: unlimited) are halved until they fit. Returns the
+// number of bytes written and throws if the source cannot be decoded.
+uint64_t transcodeTexture(const TextureSource &source,
+                          const std::filesystem::path &target, TextureFormat format,
+                          bool raw, unsigned int maxResolution);
+
+} // namespace Kontsuba
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Kontsuba {
+
+// Minimal fixed-size worker pool. Tasks are executed in submission order by
+// the first free worker; results and exceptions are delivered via futures.
+class ThreadPool {
+public:
+  // numThreads == 0 uses one worker per hardware thread
+  explicit ThreadPool(size_t numThreads = 0) {
+    if (numThreads == 0) {
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < numThreads; i++) {
+      m_workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto &worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  template <typename F>
+  auto submit(F &&f) -> std::future<std::invoke_result_t<F>> {
+    using Result = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace([task] { (*task)(); });
+    }
+    m_condition.notify_one();
+    return future;
+  }
+
+  size_t size() const { return m_workers.size(); }
+
+private:
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping = false;
+};
+
+} // namespace Kontsuba
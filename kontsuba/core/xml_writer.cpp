@@ -0,0 +1,196 @@
+#include "xml_writer.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+namespace Kontsuba {
+
+namespace {
+constexpr size_t kFlushSize = 1 << 20;
+}
+
+std::string formatFloat(float value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.8g", value);
+  return text;
+}
+
+XMLWriter::XMLWriter(const std::string &filename)
+    : m_filename(filename), m_partialFilename(filename + ".part"),
+      m_stream(m_partialFilename, std::ios::out | std::ios::binary) {
+  if (m_stream.fail()) {
+    throw std::runtime_error("failed to open " + m_partialFilename);
+  }
+  m_buffer.reserve(kFlushSize);
+}
+
+XMLWriter::~XMLWriter() {
+  if (!m_finished) {
+    m_stream.close();
+    std::error_code error;
+    std::filesystem::remove(m_partialFilename, error);
+  }
+}
+
+XMLWriter &XMLWriter::open(const std::string &name) {
+  sealElement();
+  newLine();
+  m_buffer += '<';
+  m_buffer += name;
+  m_stack.push_back(name);
+  m_elementJustOpened = true;
+  return *this;
+}
+
+XMLWriter &XMLWriter::attribute(const std::string &name, const std::string &value) {
+  if (!m_elementJustOpened) {
+    throw std::logic_error("attribute " + name + " written after element content");
+  }
+  m_buffer += ' ';
+  m_buffer += name;
+  m_buffer += "=\"";
+  escaped(value);
+  m_buffer += '"';
+  return *this;
+}
+
+XMLWriter &XMLWriter::attribute(const std::string &name, float value) {
+  return attribute(name, formatFloat(value));
+}
+
+XMLWriter &XMLWriter::close() {
+  auto name = std::move(m_stack.back());
+  m_stack.pop_back();
+  if (m_elementJustOpened) {
+    m_buffer += "/>";
+    m_elementJustOpened = false;
+  } else {
+    m_buffer += '\n';
+    m_buffer.append(4 * m_stack.size(), ' ');
+    m_buffer += "</";
+    m_buffer += name;
+    m_buffer += '>';
+  }
+  if (m_stack.empty()) {
+    m_buffer += '\n';
+  }
+  if (m_buffer.size() >= kFlushSize) {
+    flush();
+  }
+  return *this;
+}
+
+XMLWriter &XMLWriter::property(const std::string &type, const std::string &name,
+                               const std::string &value) {
+  return open(type).attribute("name", name).attribute("value", value).close();
+}
+
+void XMLWriter::finish() {
+  while (!m_stack.empty()) {
+    close();
+  }
+  flush();
+  m_stream.close();
+  if (m_stream.fail()) {
+    throw std::runtime_error("failed to write " + m_partialFilename);
+  }
+  std::filesystem::rename(m_partialFilename, m_filename);
+  m_finished = true;
+}
+
+void XMLWriter::sealElement() {
+  if (m_elementJustOpened) {
+    m_buffer += '>';
+    m_elementJustOpened = false;
+  }
+}
+
+void XMLWriter::newLine() {
+  if (!m_firstElement) {
+    m_buffer += '\n';
+  }
+  m_buffer.append(4 * m_stack.size(), ' ');
+  m_firstElement = false;
+}
+
+void XMLWriter::escaped(const std::string &text) {
+  for (char c : text) {
+    switch (c) {
+    case '"': m_buffer += "&quot;"; break;
+    case '&': m_buffer += "&amp;"; break;
+    case '\'': m_buffer += "&apos;"; break;
+    case '<': m_buffer += "&lt;"; break;
+    case '>': m_buffer += "&gt;"; break;
+    default: m_buffer += c;
+    }
+  }
+}
+
+void XMLWriter::flush() {
+  m_stream.write(m_buffer.data(), m_buffer.size());
+  if (m_stream.fail()) {
+    throw std::runtime_error("failed to write " + m_partialFilename);
+  }
+  m_buffer.clear();
+}
+
+ElementTreeWriter &ElementTreeWriter::open(const std::string &name) {
+  m_stack.emplace_back();
+  m_stack.back().name = name;
+  return *this;
+}
+
+ElementTreeWriter &ElementTreeWriter::attribute(const std::string &name,
+                                                const std::string &value) {
+  m_stack.back().attributes.emplace_back(name, value);
+  return *this;
+}
+
+ElementTreeWriter &ElementTreeWriter::attribute(const std::string &name, float value) {
+  return attribute(name, formatFloat(value));
+}
+
+ElementTreeWriter &ElementTreeWriter::close() {
+  Element element = std::move(m_stack.back());
+  m_stack.pop_back();
+  auto &siblings = m_stack.empty() ? m_elements : m_stack.back().children;
+  siblings.push_back(std::move(element));
+  return *this;
+}
+
+ElementTreeWriter &ElementTreeWriter::property(const std::string &type,
+                                               const std::string &name,
+                                               const std::string &value) {
+  return open(type).attribute("name", name).attribute("value", value).close();
+}
+
+FingerprintWriter &FingerprintWriter::open(const std::string &name) {
+  m_fingerprint += "<" + name;
+  return *this;
+}
+
+FingerprintWriter &FingerprintWriter::attribute(const std::string &name,
+                                                const std::string &value) {
+  // length prefixed so that values can't run into each other
+  m_fingerprint += " " + name + "=" + std::to_string(value.size()) + ":" + value;
+  return *this;
+}
+
+FingerprintWriter &FingerprintWriter::attribute(const std::string &name, float value) {
+  return attribute(name, formatFloat(value));
+}
+
+FingerprintWriter &FingerprintWriter::close() {
+  m_fingerprint += ">";
+  return *this;
+}
+
+FingerprintWriter &FingerprintWriter::property(const std::string &type,
+                                               const std::string &name,
+                                               const std::string &value) {
+  return open(type).attribute("name", name).attribute("value", value).close();
+}
+
+} // namespace Kontsuba
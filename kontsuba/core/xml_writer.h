@@ -0,0 +1,96 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+
+namespace Kontsuba {
+
+// float attribute text as written to scene.xml
+std::string formatFloat(float value);
+
+// Append-only XML writer that streams elements to a file as they are
+// produced instead of building a document tree first. Formatting matches
+// tinyxml2's pretty printer (four space indent, self-closing empty elements).
+//
+// The document is written to a temporary file next to `filename` and only
+// moved into place by finish(), so an aborted conversion never leaves a
+// truncated scene description behind.
+class XMLWriter {
+public:
+  explicit XMLWriter(const std::string &filename);
+  ~XMLWriter();
+
+  XMLWriter(const XMLWriter &) = delete;
+  XMLWriter &operator=(const XMLWriter &) = delete;
+
+  // start a new child element of the currently open one
+  XMLWriter &open(const std::string &name);
+  // add an attribute, only valid directly after open()
+  XMLWriter &attribute(const std::string &name, const std::string &value);
+  XMLWriter &attribute(const std::string &name, float value);
+  // close the innermost open element
+  XMLWriter &close();
+
+  // shorthand for <type name="name" value="value"/>
+  XMLWriter &property(const std::string &type, const std::string &name,
+                      const std::string &value);
+
+  // close all open elements and move the document into place
+  void finish();
+
+private:
+  void sealElement();
+  void newLine();
+  void escaped(const std::string &text);
+  void flush();
+
+  std::string m_filename;
+  std::string m_partialFilename;
+  std::ofstream m_stream;
+  std::string m_buffer;
+  std::vector<std::string> m_stack;
+  bool m_elementJustOpened = false;
+  bool m_firstElement = true;
+  bool m_finished = false;
+};
+
+// Builds the same elements as XMLWriter as a tree in memory
+class ElementTreeWriter {
+public:
+  ElementTreeWriter &open(const std::string &name);
+  ElementTreeWriter &attribute(const std::string &name, const std::string &value);
+  ElementTreeWriter &attribute(const std::string &name, float value);
+  ElementTreeWriter &close();
+  ElementTreeWriter &property(const std::string &type, const std::string &name,
+                              const std::string &value);
+
+  // the completed top level elements
+  std::vector<Element> &elements() { return m_elements; }
+
+private:
+  std::vector<Element> m_elements;
+  // elements being built, children are moved into their parent on close()
+  std::vector<Element> m_stack;
+};
+
+// Serializes the same elements into a compact string, used to find
+// identical elements
+class FingerprintWriter {
+public:
+  FingerprintWriter &open(const std::string &name);
+  FingerprintWriter &attribute(const std::string &name, const std::string &value);
+  FingerprintWriter &attribute(const std::string &name, float value);
+  FingerprintWriter &close();
+  FingerprintWriter &property(const std::string &type, const std::string &name,
+                              const std::string &value);
+
+  const std::string &fingerprint() const { return m_fingerprint; }
+
+private:
+  std::string m_fingerprint;
+};
+
+} // namespace Kontsuba
@@ -0,0 +1,554 @@
+// Checks of results that must not change when the pipeline is optimized,
+// each compares against a reference computed another way. Runs all checks,
+// or those named on the command line, and fails if any of them throws.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <fmt/core.h>
+
+#include "converter.h"
+#include "import.h"
+#include "obj_loader.h"
+#include "principled_brdf.h"
+#include "scene.h"
+#include "scene_elements.h"
+#include "tinyxml_writer.h"
+#include "xml_writer.h"
+
+namespace Kontsuba {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void check(bool condition, const std::string &message) {
+  if (!condition) {
+    throw std::runtime_error(message);
+  }
+}
+
+// an empty directory for the files of one check
+fs::path testDirectory(const std::string &name) {
+  fs::path directory = fs::temp_directory_path() / "kontsuba_tests" / name;
+  fs::remove_all(directory);
+  fs::create_directories(directory);
+  return directory;
+}
+
+std::string readFile(const fs::path &file) {
+  std::ifstream stream(file, std::ios::binary);
+  check(stream.good(), "failed to open " + file.string());
+  return std::string(std::istreambuf_iterator<char>(stream), {});
+}
+
+// materials covering every texture slot, the two-sided and map wrappers and
+// names and paths that need escaping
+std::vector<PrincipledBRDF> sampleBRDFs() {
+  std::vector<PrincipledBRDF> brdfs;
+  for (int i = 0; i < 12; i++) {
+    aiMaterial material;
+    aiString name(i == 0 ? std::string("a \"quoted\" <name> & 'more'")
+                         : fmt::format("material{}", i));
+    material.AddProperty(&name, AI_MATKEY_NAME);
+    aiColor3D diffuse(i / 11.0f, 0.1f, 1.0f / 3.0f);
+    material.AddProperty(&diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+    float roughness = 0.05f * i, metallic = 1.0f / (i + 1);
+    material.AddProperty(&roughness, 1, AI_MATKEY_ROUGHNESS_FACTOR);
+    material.AddProperty(&metallic, 1, AI_MATKEY_METALLIC_FACTOR);
+    auto addTexture = [&](aiTextureType type, const std::string &path) {
+      aiString texture(path);
+      material.AddProperty(&texture, AI_MATKEY_TEXTURE(type, 0));
+    };
+    if (i % 2 == 0) {
+      addTexture(aiTextureType_DIFFUSE, fmt::format("tex/diffuse {} & co.png", i));
+    }
+    if (i % 3 == 0) {
+      addTexture(aiTextureType_METALNESS, fmt::format("tex/metal{}.png", i));
+      addTexture(aiTextureType_DIFFUSE_ROUGHNESS, fmt::format("tex/rough{}.png", i));
+    }
+    if (i % 4 == 0) {
+      addTexture(aiTextureType_NORMALS, fmt::format("tex/normal{}.png", i));
+    }
+    if (i % 5 == 0) {
+      addTexture(aiTextureType_HEIGHT, fmt::format("tex/bump{}.png", i));
+    }
+    brdfs.push_back(PrincipledBRDF::fromMaterial(&material, i % 2 == 1));
+  }
+  return brdfs;
+}
+
+// a scene description with everything convert() writes
+template <typename Writer>
+void writeSampleScene(Writer &xml, const std::vector<PrincipledBRDF> &brdfs) {
+  xml.open("scene").attribute("version", "3.0.0");
+  writeSceneDefaults(xml);
+  for (const auto &brdf : brdfs) {
+    toXML(xml, brdf);
+  }
+  aiMatrix4x4 transform(0.1f, 2.0f / 3.0f, 0.0f, -4.5f, 1e-7f, 1.0f, 0.0f, 12345.678f,
+                        0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+  for (size_t i = 0; i < brdfs.size(); i++) {
+    xml.open("shape").attribute("type", "ply");
+    xml.property("string", "filename", fmt::format("meshes/mesh {}.ply", i));
+    toXML(xml, transform);
+    xml.open("ref").attribute("id", brdfs[i].name).close();
+    xml.close();
+  }
+  xml.open("shapegroup").attribute("id", "group0");
+  xml.open("shape").attribute("type", "serialized");
+  xml.property("string", "filename", "meshes/scene.serialized");
+  xml.property("integer", "shape_index", "0");
+  xml.open("ref").attribute("id", brdfs[0].name).close();
+  xml.close();
+  xml.close();
+  xml.open("shape").attribute("type", "instance");
+  xml.open("ref").attribute("id", "group0").close();
+  toXML(xml, transform);
+  xml.close();
+  xml.open("float").attribute("name", "scale").attribute("value", 0.3f).close();
+  xml.close();
+}
+
+// XMLWriter streams the same bytes the tinyxml2 DOM used to save
+void xmlWriterMatchesTinyxml2() {
+  fs::path directory = testDirectory("xml_writer");
+  auto brdfs = sampleBRDFs();
+
+  XMLWriter streamed((directory / "streamed.xml").string());
+  writeSampleScene(streamed, brdfs);
+  streamed.finish();
+
+  TinyXMLWriter dom;
+  writeSampleScene(dom, brdfs);
+  dom.save((directory / "dom.xml").string());
+
+  std::string expected = readFile(directory / "dom.xml");
+  std::string actual = readFile(directory / "streamed.xml");
+  auto [a, b] = std::mismatch(actual.begin(), actual.end(), expected.begin(), expected.end());
+  check(a == actual.end() && b == expected.end(),
+        fmt::format("scene descriptions differ at byte {}", a - actual.begin()));
+}
+
+// XMLWriter writes the scene.xml the converter wrote when it still built a
+// tinyxml2 DOM, saved in golden/baseline_scene.xml, for a textured,
+// bump-mapped, two-sided material and a plain one
+void xmlWriterMatchesBaselineScene() {
+  PrincipledBRDF painted;
+  painted.name = "painted";
+  painted.base_color.texture = "tex/albedo.png";
+  painted.roughness.texture = "tex/roughness.png";
+  painted.metallic.value = 1.0f / 3.0f;
+  painted.specular.value = 0.123456789f;
+  painted.bumpMap = "tex/bump.png";
+  painted.twoSided = true;
+
+  PrincipledBRDF plain;
+  plain.name = "plain";
+  plain.base_color.value = aiColor3D(0.25f, 0.5f, 1.0f);
+  plain.roughness.value = 0.05f;
+  plain.clearcoat.value = 1e-7f;
+  plain.twoSided = true;
+
+  fs::path file = testDirectory("baseline_scene") / "scene.xml";
+  XMLWriter xml(file.string());
+  xml.open("scene").attribute("version", "3.0.0");
+  writeSceneDefaults(xml);
+  toXML(xml, painted);
+  toXML(xml, plain);
+  const PrincipledBRDF *materials[] = {&painted, &plain};
+  for (size_t i = 0; i < 2; i++) {
+    xml.open("shape").attribute("type", "ply");
+    xml.property("string", "filename", fmt::format("meshes/mesh{}.ply", i));
+    xml.open("ref").attribute("id", materials[i]->name).close();
+    xml.close();
+  }
+  xml.close();
+  xml.finish();
+
+  std::string expected = readFile(fs::path(KONTSUBA_GOLDEN_DIR) / "baseline_scene.xml");
+  std::string actual = readFile(file);
+  auto [a, b] = std::mismatch(actual.begin(), actual.end(), expected.begin(), expected.end());
+  check(a == actual.end() && b == expected.end(),
+        fmt::format("scene.xml differs from the baseline at byte {}", a - actual.begin()));
+}
+
+// a quad of two triangles with unshared corners whose texture has a
+// KHR_texture_transform, so FlipUVs, TransformUVCoords and
+// JoinIdenticalVertices all change it. The texture is read from `imageUri`.
+fs::path writeTransformedQuad(const fs::path &directory,
+                              const std::string &imageUri = "albedo.png") {
+  const float positions[6][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0},
+                                 {0, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+  std::vector<float> data;
+  for (const auto &p : positions) {
+    data.insert(data.end(), p, p + 3);
+  }
+  for (int i = 0; i < 6; i++) {
+    data.insert(data.end(), {0.0f, 0.0f, 1.0f});
+  }
+  for (const auto &p : positions) {
+    data.insert(data.end(), {0.2f + 0.6f * p[0], 0.1f + 0.7f * p[1]});
+  }
+  std::ofstream(directory / "quad.bin", std::ios::binary)
+      .write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(float));
+
+  fs::path file = directory / "quad.gltf";
+  std::ofstream(file) << R"({
+  "asset": {"version": "2.0"},
+  "extensionsUsed": ["KHR_texture_transform"],
+  "scene": 0,
+  "scenes": [{"nodes": [0]}],
+  "nodes": [{"mesh": 0}],
+  "meshes": [{"primitives": [{
+    "attributes": {"POSITION": 0, "NORMAL": 1, "TEXCOORD_0": 2},
+    "material": 0
+  }]}],
+  "materials": [{"pbrMetallicRoughness": {"baseColorTexture": {
+    "index": 0,
+    "extensions": {"KHR_texture_transform":
+                   {"offset": [0.25, 0.5], "rotation": 0.3, "scale": [2, 3]}}
+  }}}],
+  "textures": [{"source": 0}],
+  "images": [{"uri": ")" + imageUri + R"("}],
+  "buffers": [{"uri": "quad.bin", "byteLength": 192}],
+  "bufferViews": [
+    {"buffer": 0, "byteOffset": 0, "byteLength": 72},
+    {"buffer": 0, "byteOffset": 72, "byteLength": 72},
+    {"buffer": 0, "byteOffset": 144, "byteLength": 48}
+  ],
+  "accessors": [
+    {"bufferView": 0, "componentType": 5126, "count": 6, "type": "VEC3",
+     "min": [0, 0, 0], "max": [1, 1, 0]},
+    {"bufferView": 1, "componentType": 5126, "count": 6, "type": "VEC3"},
+    {"bufferView": 2, "componentType": 5126, "count": 6, "type": "VEC2"}
+  ]
+})";
+  return file;
+}
+
+template <typename T>
+bool sameArray(const T *a, const T *b, size_t count) {
+  if (a == nullptr || b == nullptr) {
+    return a == b;
+  }
+  return std::memcmp(a, b, count * sizeof(T)) == 0;
+}
+
+void checkSameMeshes(const aiScene *a, const aiScene *b) {
+  check(a->mNumMeshes == b->mNumMeshes,
+        fmt::format("{} meshes instead of {}", b->mNumMeshes, a->mNumMeshes));
+  for (unsigned int m = 0; m < a->mNumMeshes; m++) {
+    const aiMesh *x = a->mMeshes[m], *y = b->mMeshes[m];
+    std::string mesh = fmt::format("mesh {}: ", m);
+    check(x->mNumVertices == y->mNumVertices && x->mNumFaces == y->mNumFaces,
+          mesh + fmt::format("{} vertices and {} faces instead of {} and {}", y->mNumVertices,
+                             y->mNumFaces, x->mNumVertices, x->mNumFaces));
+    check(sameArray(x->mVertices, y->mVertices, x->mNumVertices), mesh + "positions differ");
+    check(sameArray(x->mNormals, y->mNormals, x->mNumVertices), mesh + "normals differ");
+    check(sameArray(x->mTextureCoords[0], y->mTextureCoords[0], x->mNumVertices),
+          mesh + "texture coordinates differ");
+    for (unsigned int f = 0; f < x->mNumFaces; f++) {
+      const aiFace &p = x->mFaces[f], &q = y->mFaces[f];
+      check(p.mNumIndices == q.mNumIndices && sameArray(p.mIndices, q.mIndices, p.mNumIndices),
+            mesh + fmt::format("face {} differs", f));
+    }
+  }
+}
+
+// applying the post-processing steps one at a time for
+// --time-post-processing gives the same meshes as a single ReadFile
+void postProcessingStepsMatchReadFile() {
+  fs::path file = writeTransformedQuad(testDirectory("post_processing"));
+  Options options;
+  Assimp::Importer combined, separate;
+  std::unique_ptr<aiScene> combinedOwned, separateOwned;
+  const aiScene *expected = importScene(combined, file, options, combinedOwned);
+  options.timePostProcessing = true;
+  const aiScene *actual = importScene(separate, file, options, separateOwned);
+  check(expected->mNumMeshes == 1 && expected->mMeshes[0]->mNumVertices == 4,
+        "the quad was not imported and joined into 4 vertices");
+  checkSameMeshes(expected, actual);
+}
+
+// a 1x1 PNG
+constexpr const char *kPngBase64 =
+    "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mP8z8BQDwAEhQGAhKmM"
+    "IQAAAABJRU5ErkJggg==";
+constexpr size_t kPngBytes = 70;
+
+// filename of every bitmap below `elements`
+void bitmapFilenames(const std::vector<Element> &elements, std::vector<std::string> &filenames) {
+  for (const auto &element : elements) {
+    const std::string *name = element.attribute("name");
+    if (element.name == "string" && name && *name == "filename") {
+      filenames.push_back(*element.attribute("value"));
+    }
+    bitmapFilenames(element.children, filenames);
+  }
+}
+
+// the in-memory scene writes embedded textures to files that exist as long
+// as the scene instead of referring to them by their "*N" names
+void loadSceneExtractsEmbeddedTextures() {
+  fs::path file = writeTransformedQuad(testDirectory("embedded_textures"),
+                                       std::string("data:image/png;base64,") + kPngBase64);
+  fs::path textureDirectory;
+  {
+    auto scene = loadScene(file.string());
+    std::vector<std::string> filenames;
+    bitmapFilenames(scene->elements(), filenames);
+    check(filenames.size() == 1, fmt::format("{} bitmaps instead of 1", filenames.size()));
+    fs::path texture = filenames.front();
+    check(texture.is_absolute() && fs::exists(texture), texture.string() + " does not exist");
+    std::string contents = readFile(texture);
+    check(contents.size() == kPngBytes && contents.rfind("\x89PNG", 0) == 0,
+          texture.string() + " is not the embedded PNG");
+    textureDirectory = texture.parent_path();
+  }
+  check(!fs::exists(textureDirectory), "the extracted textures outlive the scene");
+}
+
+const aiMaterial *findMaterial(const aiScene *scene, const std::string &name) {
+  for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+    aiString materialName;
+    if (scene->mMaterials[i]->Get(AI_MATKEY_NAME, materialName) == aiReturn_SUCCESS &&
+        name == materialName.C_Str()) {
+      return scene->mMaterials[i];
+    }
+  }
+  throw std::runtime_error("missing material " + name);
+}
+
+// the built-in OBJ loader reads MTL statements regardless of their case,
+// like Assimp's importer
+void objLoaderMatchesMtlKeywordsInAnyCase() {
+  fs::path directory = testDirectory("mtl_keywords");
+  std::ofstream(directory / "case.mtl") << "newmtl lower\n"
+                                           "kd 0.1 0.2 0.3\n"
+                                           "map_kd diffuse.png\n"
+                                           "map_bump -bm 0.5 bump.png\n"
+                                           "newmtl upper\n"
+                                           "KD 0.4 0.5 0.6\n"
+                                           "MAP_KD diffuse.png\n"
+                                           "Map_Bump bump.png\n"
+                                           "NORM normal.png\n"
+                                           "illum 2\n"
+                                           "not_a_statement 1\n";
+  std::ofstream(directory / "case.obj") << "mtllib case.mtl\n"
+                                           "v 0 0 0\nv 1 0 0\nv 0 1 0\n"
+                                           "usemtl lower\nf 1 2 3\n"
+                                           "usemtl upper\nf 1 2 3\n";
+
+  Assimp::DefaultIOSystem io;
+  auto scene = loadObj(io, directory / "case.obj", Options());
+  const std::pair<const char *, aiColor3D> materials[] = {{"lower", {0.1f, 0.2f, 0.3f}},
+                                                          {"upper", {0.4f, 0.5f, 0.6f}}};
+  for (const auto &[name, expectedDiffuse] : materials) {
+    const aiMaterial *material = findMaterial(scene.get(), name);
+    aiColor3D diffuse;
+    check(material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == aiReturn_SUCCESS &&
+              diffuse == expectedDiffuse,
+          fmt::format("{}: wrong diffuse color", name));
+    const std::pair<aiTextureType, const char *> textures[] = {
+        {aiTextureType_DIFFUSE, "diffuse.png"}, {aiTextureType_HEIGHT, "bump.png"}};
+    for (const auto &[type, file] : textures) {
+      aiString path;
+      check(material->GetTexture(type, 0, &path) == aiReturn_SUCCESS &&
+                file == std::string(path.C_Str()),
+            fmt::format("{}: missing texture {}", name, file));
+    }
+  }
+  aiString normal;
+  check(findMaterial(scene.get(), "upper")->GetTexture(aiTextureType_NORMALS, 0, &normal) ==
+            aiReturn_SUCCESS,
+        "upper: missing normal map");
+}
+
+// the built-in OBJ loader gives the meshes Assimp gives, with
+// JoinIdenticalVertices and without it; faces with more than four corners
+// are left to Assimp
+void objLoaderMatchesAssimp() {
+  fs::path directory = testDirectory("obj_loader_assimp");
+  std::ofstream(directory / "shapes.mtl") << "newmtl a\nKd 1 0 0\n"
+                                             "newmtl b\nKd 0 1 0\n";
+  // two quads sharing an edge, once by the same indices and once by a
+  // position that is listed twice, a concave quad whose fan has to start at
+  // its last corner and a triangle of another material
+  std::ofstream(directory / "quads.obj") << "mtllib shapes.mtl\n"
+                                            "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                                            "v 2 0 0\nv 2 1 0\nv 1 1 0\n"
+                                            "v 3 0 0\nv 5 1 0\nv 3 2 0\nv 4 1 0\n"
+                                            "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+                                            "vn 0 0 1\n"
+                                            "usemtl a\n"
+                                            "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+                                            "f 2/2/1 5/1/1 6/4/1 7/3/1\n"
+                                            "f 8/1/1 9/2/1 10/3/1 11/4/1\n"
+                                            "usemtl b\n"
+                                            "f 1/1/1 2/2/1 7/3/1\n";
+  // a pentagon with a concave corner
+  std::ofstream(directory / "pentagon.obj") << "mtllib shapes.mtl\n"
+                                               "v 0 3 0\nv 2 3 0\nv 2 5 0\nv 1 4 0\nv 0 5 0\n"
+                                               "vn 0 0 1\n"
+                                               "usemtl a\n"
+                                               "f 1//1 2//1 3//1 4//1 5//1\n";
+
+  for (bool join : {true, false}) {
+    Options options;
+    options.postProcessing.joinIdenticalVertices = join;
+    Options assimpOptions = options;
+    assimpOptions.fastObj = false;
+    std::string setting = join ? "joined: " : "not joined: ";
+
+    Assimp::DefaultIOSystem io;
+    auto actual = loadObj(io, directory / "quads.obj", options);
+    Assimp::Importer importer;
+    std::unique_ptr<aiScene> owned;
+    try {
+      checkSameMeshes(importScene(importer, directory / "quads.obj", assimpOptions, owned),
+                      actual.get());
+    } catch (std::exception &e) {
+      throw std::runtime_error(setting + e.what());
+    }
+
+    bool loaded = true;
+    try {
+      loadObj(io, directory / "pentagon.obj", options);
+    } catch (std::exception &) {
+      loaded = false;
+    }
+    check(!loaded, setting + "the pentagon was not left to Assimp");
+    Assimp::Importer fastImporter, assimpImporter;
+    std::unique_ptr<aiScene> fastOwned, assimpOwned;
+    const aiScene *fast =
+        importScene(fastImporter, directory / "pentagon.obj", options, fastOwned);
+    try {
+      checkSameMeshes(importScene(assimpImporter, directory / "pentagon.obj", assimpOptions,
+                                  assimpOwned),
+                      fast);
+    } catch (std::exception &e) {
+      throw std::runtime_error(setting + "pentagon: " + e.what());
+    }
+  }
+}
+
+// every file below `directory` by its relative path
+std::map<std::string, std::string> readTree(const fs::path &directory) {
+  std::map<std::string, std::string> files;
+  for (const auto &entry : fs::recursive_directory_iterator(directory)) {
+    if (entry.is_regular_file()) {
+      files[fs::relative(entry.path(), directory).generic_string()] = readFile(entry.path());
+    }
+  }
+  return files;
+}
+
+// `meshes` wavy grids of `triangles` triangles each, with one material per mesh
+fs::path writeGridScene(const fs::path &directory, int meshes, int triangles) {
+  std::ofstream mtl(directory / "grids.mtl");
+  std::ofstream obj(directory / "grids.obj");
+  obj << "mtllib grids.mtl\n";
+  const int width = static_cast<int>(std::ceil(std::sqrt(triangles / 2.0)));
+  int firstVertex = 1;
+  for (int m = 0; m < meshes; m++) {
+    mtl << fmt::format("newmtl m{}\nKd {} 0.5 0.5\n", m, m / float(meshes));
+    obj << fmt::format("o grid{}\nusemtl m{}\n", m, m);
+    for (int y = 0; y <= width; y++) {
+      for (int x = 0; x <= width; x++) {
+        obj << fmt::format("v {} {} {}\nvt {} {}\n", x, y, std::sin(x + m) * std::cos(y),
+                           x / float(width), y / float(width));
+      }
+    }
+    for (int t = 0; t < triangles; t++) {
+      int quad = t / 2, a = firstVertex + quad / width * (width + 1) + quad % width;
+      int b = a + 1, c = a + width + 2, d = a + width + 1;
+      obj << (t % 2 == 0 ? fmt::format("f {0}/{0} {1}/{1} {2}/{2}\n", a, b, c)
+                         : fmt::format("f {0}/{0} {1}/{1} {2}/{2}\n", a, c, d));
+    }
+    firstVertex += (width + 1) * (width + 1);
+  }
+  return directory / "grids.obj";
+}
+
+// holding meshes back to stay within Options::memoryBudget does not change
+// the output, even when the budget is smaller than a single mesh
+void memoryBudgetKeepsOutput() {
+  fs::path directory = testDirectory("memory_budget");
+  fs::path input = writeGridScene(directory, 24, 2000);
+  constexpr uint64_t kBudget = 16 * 1024;
+  for (MeshFormat format : {MeshFormat::Ply, MeshFormat::Serialized}) {
+    Options options;
+    options.meshFormat = format;
+    options.jobs = 4;
+    fs::path unlimited = directory / "unlimited", budgeted = directory / "budgeted";
+    fs::remove_all(unlimited);
+    fs::remove_all(budgeted);
+    fs::create_directories(unlimited);
+    fs::create_directories(budgeted);
+    convert(input.string(), unlimited.string(), options);
+    options.memoryBudget = kBudget;
+    convert(input.string(), budgeted.string(), options);
+
+    auto expected = readTree(unlimited);
+    uint64_t meshBytes = 0;
+    for (const auto &[file, contents] : expected) {
+      meshBytes += file.rfind("meshes/", 0) == 0 ? contents.size() : 0;
+    }
+    check(meshBytes > 4 * kBudget, "the scene does not exceed the budget");
+    check(readTree(budgeted) == expected,
+          format == MeshFormat::Ply ? "ply output differs" : "serialized output differs");
+  }
+}
+
+struct Test {
+  const char *name;
+  void (*run)();
+};
+
+const Test kTests[] = {
+    {"xml_writer_matches_tinyxml2", xmlWriterMatchesTinyxml2},
+    {"xml_writer_matches_baseline_scene", xmlWriterMatchesBaselineScene},
+    {"post_processing_steps_match_read_file", postProcessingStepsMatchReadFile},
+    {"load_scene_extracts_embedded_textures", loadSceneExtractsEmbeddedTextures},
+    {"obj_loader_matches_mtl_keywords_in_any_case", objLoaderMatchesMtlKeywordsInAnyCase},
+    {"obj_loader_matches_assimp", objLoaderMatchesAssimp},
+    {"memory_budget_keeps_output", memoryBudgetKeepsOutput},
+};
+
+} // namespace
+
+} // namespace Kontsuba
+
+int main(int argc, char **argv) {
+  std::vector<std::string> selected(argv + 1, argv + argc);
+  int failed = 0;
+  for (const auto &test : Kontsuba::kTests) {
+    if (!selected.empty() &&
+        std::find(selected.begin(), selected.end(), test.name) == selected.end()) {
+      continue;
+    }
+    try {
+      test.run();
+      std::cout << "passed " << test.name << std::endl;
+    } catch (std::exception &e) {
+      std::cout << "FAILED " << test.name << ": " << e.what() << std::endl;
+      failed++;
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <tinyxml2.h>
+
+namespace Kontsuba {
+
+// Builds the scene description as a tinyxml2 DOM like the converter did
+// before it streamed scene.xml. Serves as the reference XMLWriter has to
+// match byte for byte and as its baseline in the benchmarks.
+class TinyXMLWriter {
+public:
+  TinyXMLWriter &open(const std::string &name) {
+    auto element = m_document.NewElement(name.c_str());
+    if (m_stack.empty()) {
+      m_document.InsertEndChild(element);
+    } else {
+      m_stack.back()->InsertEndChild(element);
+    }
+    m_stack.push_back(element);
+    return *this;
+  }
+  TinyXMLWriter &attribute(const std::string &name, const std::string &value) {
+    m_stack.back()->SetAttribute(name.c_str(), value.c_str());
+    return *this;
+  }
+  // tinyxml2's own formatting, so the check covers XMLWriter's
+  TinyXMLWriter &attribute(const std::string &name, float value) {
+    m_stack.back()->SetAttribute(name.c_str(), value);
+    return *this;
+  }
+  TinyXMLWriter &close() {
+    m_stack.pop_back();
+    return *this;
+  }
+  TinyXMLWriter &property(const std::string &type, const std::string &name,
+                          const std::string &value) {
+    return open(type).attribute("name", name).attribute("value", value).close();
+  }
+  void save(const std::string &filename) { m_document.SaveFile(filename.c_str()); }
+
+private:
+  tinyxml2::XMLDocument m_document;
+  std::vector<tinyxml2::XMLElement *> m_stack;
+};
+
+} // namespace Kontsuba
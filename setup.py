@@ -23,5 +23,6 @@ setup(
     cmake_install_dir="kontsuba/bindings/kontsuba",
     cmake_languages=("C", "CXX"),
     include_package_data=True,
+    install_requires=["numpy"],
     python_requires=">=3.9"
 )
\ No newline at end of file
@@ -4,8 +4,7 @@ import kontsuba
 
 mi.set_variant("scalar_rgb")
 
-kontsuba.convert("./test_models/shapenet/models/model_normalized.obj", "tmp") # TODO directly return Python dict
-scene = mi.load_file("./tmp/scene.xml")
+scene = mi.load_dict(kontsuba.load_dict("./test_models/shapenet/models/model_normalized.obj"))
 
 img = mi.render(scene)
 plt.imshow(img ** (1 / 2.2)) # gamma correction